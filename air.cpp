@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <utility>
+
+#include "air.h"
+#include "jobs.h"
+#include "rng.h"
+#include "world.h"
+
+// Fraction of pressure and velocity kept each tick
+static constexpr float AIR_PRESSURE_DECAY = 0.99f;
+static constexpr float AIR_VELOCITY_DECAY = 0.98f;
+// How strongly velocity divergence builds pressure, and pressure gradients push the air.
+// Their product must stay well under one half for the explicit step to be stable.
+static constexpr float AIR_PRESSURE_STEP = 0.25f;
+static constexpr float AIR_VELOCITY_STEP = 0.25f;
+// Share of each cell's value that is swapped with its four neighbours, which damps the
+// checkerboard pattern central differences leave behind
+static constexpr float AIR_BLUR = 0.1f;
+// Slowest wind that wakes sleeping particles. Anything gentler can't lift a settled
+// powder against gravity with the drags the elements use.
+static constexpr float AIR_WAKE = 0.5f;
+// Rows stepped per job
+static constexpr int AIR_BAND = 8;
+
+static constexpr int AIR_CELLS = paddedSize(AIR_X, AIR_Y);
+
+Air::Air() :
+	pressure(AIR_CELLS),
+	vx(AIR_CELLS),
+	vy(AIR_CELLS),
+	nextPressure(AIR_CELLS),
+	nextVx(AIR_CELLS),
+	nextVy(AIR_CELLS) {
+}
+
+void Air::clear() {
+	std::fill(this->pressure.begin(), this->pressure.end(), 0.0f);
+	std::fill(this->vx.begin(), this->vx.end(), 0.0f);
+	std::fill(this->vy.begin(), this->vy.end(), 0.0f);
+}
+
+uint64_t Air::checksum() const {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (const std::vector<float>* field : { &this->pressure, &this->vx, &this->vy }) {
+		const uint8_t* bytes = (const uint8_t*)field->data();
+		for (size_t i = 0; i < field->size() * sizeof(float); i++) {
+			hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+		}
+	}
+	return mixBits(hash);
+}
+
+void Air::step(World& world, JobSystem* jobs) {
+	// Pressure is advanced from the old velocities, then velocity from the new pressure
+	runBands(jobs, AIR_Y, AIR_BAND, [this](int, int y0, int y1) {
+		stepPressure(y0, y1);
+	});
+	std::swap(this->pressure, this->nextPressure);
+	runBands(jobs, AIR_Y, AIR_BAND, [this](int, int y0, int y1) {
+		stepVelocity(y0, y1);
+	});
+	std::swap(this->vx, this->nextVx);
+	std::swap(this->vy, this->nextVy);
+
+	for (int y = 0; y < AIR_Y; y++) {
+		for (int x = 0; x < AIR_X; x++) {
+			int i = index(x, y);
+			if (this->vx[i] * this->vx[i] + this->vy[i] * this->vy[i] > AIR_WAKE * AIR_WAKE) {
+				olc::vi2d min = olc::vi2d(x, y) * AIR_CELL;
+				world.wakeArea(min, min + olc::vi2d(AIR_CELL - 1, AIR_CELL - 1));
+			}
+		}
+	}
+}
+
+// One row of each stencil
+static void stepPressureRow(float* __restrict out, const float* __restrict p, const float* __restrict u, const float* __restrict v, int stride) {
+	for (int x = 0; x < AIR_X; x++) {
+		float blurred = p[x] * (1 - 4 * AIR_BLUR) + (p[x - 1] + p[x + 1] + p[x - stride] + p[x + stride]) * AIR_BLUR;
+		float divergence = (u[x + 1] - u[x - 1] + v[x + stride] - v[x - stride]) * 0.5f;
+		out[x] = (blurred - divergence * AIR_PRESSURE_STEP) * AIR_PRESSURE_DECAY;
+	}
+}
+
+static void stepVelocityRow(float* __restrict outU, float* __restrict outV, const float* __restrict p, const float* __restrict u, const float* __restrict v, int stride) {
+	for (int x = 0; x < AIR_X; x++) {
+		float blurredU = u[x] * (1 - 4 * AIR_BLUR) + (u[x - 1] + u[x + 1] + u[x - stride] + u[x + stride]) * AIR_BLUR;
+		float blurredV = v[x] * (1 - 4 * AIR_BLUR) + (v[x - 1] + v[x + 1] + v[x - stride] + v[x + stride]) * AIR_BLUR;
+		outU[x] = (blurredU - (p[x + 1] - p[x - 1]) * 0.5f * AIR_VELOCITY_STEP) * AIR_VELOCITY_DECAY;
+		outV[x] = (blurredV - (p[x + stride] - p[x - stride]) * 0.5f * AIR_VELOCITY_STEP) * AIR_VELOCITY_DECAY;
+	}
+}
+
+void Air::stepPressure(int y0, int y1) {
+	for (int y = y0; y < y1; y++) {
+		int row = index(0, y);
+		stepPressureRow(&this->nextPressure[row], &this->pressure[row], &this->vx[row], &this->vy[row], STRIDE);
+	}
+}
+
+void Air::stepVelocity(int y0, int y1) {
+	for (int y = y0; y < y1; y++) {
+		int row = index(0, y);
+		stepVelocityRow(&this->nextVx[row], &this->nextVy[row], &this->pressure[row], &this->vx[row], &this->vy[row], STRIDE);
+	}
+}
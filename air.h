@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "olcPixelGameEngine.h"
+#include "sandbox.h"
+#include "stencil.h"
+
+class World;
+
+// Air moves on a coarse grid of AIR_CELL cells square
+static constexpr int AIR_CELL = 4;
+static constexpr int AIR_X = PIX_X / AIR_CELL;
+static constexpr int AIR_Y = PIX_Y / AIR_CELL;
+
+// Pressure and velocity of the air, advanced one tick at a time by explicit stencils.
+// Each field is a separate padded grid whose border is still air.
+class Air {
+public:
+	Air();
+
+	void clear();
+	// Rows are split over the jobs when given. Particles under a cell whose wind is
+	// strong enough to move them are woken.
+	void step(World& world, JobSystem* jobs);
+
+	// Particles moving through the air drag it along and some add pressure. Not safe to
+	// call while the air is stepping.
+	inline void push(olc::vi2d pos, olc::vf2d velocity, float pressure) {
+		int i = index(pos.x / AIR_CELL, pos.y / AIR_CELL);
+		this->vx[i] += velocity.x;
+		this->vy[i] += velocity.y;
+		this->pressure[i] += pressure;
+	}
+
+	inline olc::vf2d sample(olc::vi2d pos) const {
+		int i = index(pos.x / AIR_CELL, pos.y / AIR_CELL);
+		return olc::vf2d(this->vx[i], this->vy[i]);
+	}
+
+	// Hash of the pressure and velocity of every cell
+	uint64_t checksum() const;
+
+private:
+	static constexpr int STRIDE = AIR_X + 2;
+
+	std::vector<float> pressure;
+	std::vector<float> vx;
+	std::vector<float> vy;
+	std::vector<float> nextPressure;
+	std::vector<float> nextVx;
+	std::vector<float> nextVy;
+
+	static inline int index(int x, int y) {
+		return paddedIndex(x, y, AIR_X);
+	}
+
+	void stepPressure(int y0, int y1);
+	void stepVelocity(int y0, int y1);
+};
@@ -0,0 +1,331 @@
+// Headless runner for the simulation core, no window or renderer required.
+// Build the SandboxBench project on Windows, or the sandbox-bench CMake target elsewhere.
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(OLC_PGE_HEADLESS)
+#define OLC_PGE_HEADLESS
+#endif
+#define OLC_PGE_APPLICATION
+#include "olcPixelGameEngine.h"
+
+#include "sandbox.h"
+#include "particles.h"
+#include "simulation.h"
+#include "world.h"
+
+typedef struct {
+	std::string scenario;
+	int ticks;
+	int worlds;
+	int threads;
+	bool deterministic;
+	bool air;
+	bool heat;
+	MoveModel moveModel;
+	uint64_t seed;
+} BenchOptions;
+
+typedef struct {
+	size_t startParts;
+	size_t endParts;
+	uint64_t particleTicks;
+	uint64_t removed;
+	uint64_t visited;
+	uint64_t sleeping;
+	uint64_t compactNs;
+	uint64_t reorderNs;
+	uint64_t airNs;
+	uint64_t heatNs;
+	uint64_t checksum;
+	std::vector<double> utilisation;
+	bool ok;
+} BenchResult;
+
+static void usage() {
+	std::cout << "Usage: sandbox-bench [-s scenario] [-n ticks] [-w worlds] [-t threads] [-d] [-a] [-H] [-m moves] [-r seed]" << std::endl;
+	std::cout << "  -s  dust, water, fire, mixed, or a scenario file (default: mixed)" << std::endl;
+	std::cout << "  -n  number of ticks to run (default: 1000)" << std::endl;
+	std::cout << "  -w  number of independent worlds run in parallel (default: 1)" << std::endl;
+	std::cout << "  -t  threads per world, 1 runs the serial tick (default: 1)" << std::endl;
+	std::cout << "  -d  deterministic mode, the result is the same for any number of threads" << std::endl;
+	std::cout << "  -a  step the air and couple particles to it" << std::endl;
+	std::cout << "  -H  diffuse heat and ignite by temperature" << std::endl;
+	std::cout << "  -m  move model, sequential or intents (default: sequential)" << std::endl;
+	std::cout << "  -r  world seed (default: random)" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Scenario files hold one command per line:" << std::endl;
+	std::cout << "  gravity vector|radial|field|self|off" << std::endl;
+	std::cout << "  attractor x y strength falloff" << std::endl;
+	std::cout << "  repulsor x y strength falloff" << std::endl;
+	std::cout << "  zone x y w h pullX pullY" << std::endl;
+	std::cout << "  fill TYPE x y w h" << std::endl;
+}
+
+static void fill(World& world, Type type, int x0, int y0, int w, int h) {
+	for (int y = y0; y < y0 + h; y++) {
+		for (int x = x0; x < x0 + w; x++) {
+			if (inBounds(x, y) && world.grid[y][x] == NO_PARTICLE) {
+				world.add(olc::vi2d(x, y), type);
+			}
+		}
+	}
+}
+
+static bool parseType(const std::string& name, Type& type) {
+	for (int i = 0; i < NONE; i++) {
+		if (getProps((Type)i).name == name) {
+			type = (Type)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool loadScenario(World& world, const std::string& path) {
+	std::ifstream file(path);
+	if (!file) {
+		std::cerr << "Cannot open scenario " << path << std::endl;
+		return false;
+	}
+	std::string line;
+	int lineNum = 0;
+	while (std::getline(file, line)) {
+		lineNum++;
+		std::istringstream in(line);
+		std::string command;
+		if (!(in >> command) || command[0] == '#') continue;
+		if (command == "gravity") {
+			std::string mode;
+			in >> mode;
+			if (mode == "vector") world.config.gravType = GravityType::VECTOR;
+			else if (mode == "radial") world.config.gravType = GravityType::RADIAL;
+			else if (mode == "field") world.config.gravType = GravityType::FIELD;
+			else if (mode == "self") world.config.gravType = GravityType::SELF;
+			else if (mode == "off") world.config.gravType = GravityType::OFF;
+			else {
+				std::cerr << path << ":" << lineNum << ": unknown gravity " << mode << std::endl;
+				return false;
+			}
+		} else if (command == "attractor" || command == "repulsor") {
+			float x, y, strength, falloff;
+			if (!(in >> x >> y >> strength >> falloff)) {
+				std::cerr << path << ":" << lineNum << ": bad " << command << std::endl;
+				return false;
+			}
+			olc::vf2d pos = olc::vf2d(x, y);
+			world.gravityField.addSource(command == "attractor" ? makeAttractor(pos, strength, falloff) : makeRepulsor(pos, strength, falloff));
+		} else if (command == "zone") {
+			float x, y, w, h, pullX, pullY;
+			if (!(in >> x >> y >> w >> h >> pullX >> pullY)) {
+				std::cerr << path << ":" << lineNum << ": bad zone" << std::endl;
+				return false;
+			}
+			world.gravityField.addSource(makeZone(olc::vf2d(x, y), olc::vf2d(w, h), olc::vf2d(pullX, pullY)));
+		} else if (command == "fill") {
+			std::string name;
+			Type type;
+			int x, y, w, h;
+			if (!(in >> name >> x >> y >> w >> h) || !parseType(name, type)) {
+				std::cerr << path << ":" << lineNum << ": bad fill" << std::endl;
+				return false;
+			}
+			fill(world, type, x, y, w, h);
+		} else {
+			std::cerr << path << ":" << lineNum << ": unknown command " << command << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool buildScenario(World& world, const std::string& name) {
+	if (name == "dust") {
+		fill(world, Type::DUST, 10, 0, PIX_X - 20, 150);
+	} else if (name == "water") {
+		fill(world, Type::BRICK, 0, PIX_Y - 5, PIX_X, 5);
+		fill(world, Type::WATER, 60, 0, 200, 200);
+	} else if (name == "fire") {
+		fill(world, Type::DUST, 0, PIX_Y - 120, PIX_X, 120);
+		fill(world, Type::FIRE, PIX_X / 2 - 5, PIX_Y - 125, 10, 5);
+	} else if (name == "mixed") {
+		fill(world, Type::BRICK, 0, PIX_Y - 5, PIX_X, 5);
+		fill(world, Type::DUST, 0, 60, PIX_X / 3, 100);
+		fill(world, Type::WATER, PIX_X / 3, 60, PIX_X / 3, 100);
+		fill(world, Type::GAS, 2 * PIX_X / 3, 60, PIX_X / 3, 100);
+		fill(world, Type::FIRE, 2 * PIX_X / 3, 170, 20, 5);
+	} else {
+		return loadScenario(world, name);
+	}
+	return true;
+}
+
+static bool parseArgs(int argc, char** argv, BenchOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (std::strcmp(argv[i], "-s") == 0 && hasValue) {
+			options.scenario = argv[++i];
+		} else if (std::strcmp(argv[i], "-n") == 0 && hasValue) {
+			options.ticks = std::atoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "-w") == 0 && hasValue) {
+			options.worlds = std::atoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "-t") == 0 && hasValue) {
+			options.threads = std::atoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "-d") == 0) {
+			options.deterministic = true;
+		} else if (std::strcmp(argv[i], "-a") == 0) {
+			options.air = true;
+		} else if (std::strcmp(argv[i], "-H") == 0) {
+			options.heat = true;
+		} else if (std::strcmp(argv[i], "-m") == 0 && hasValue) {
+			i++;
+			if (std::strcmp(argv[i], "sequential") == 0) options.moveModel = MoveModel::SEQUENTIAL;
+			else if (std::strcmp(argv[i], "intents") == 0) options.moveModel = MoveModel::INTENTS;
+			else return false;
+		} else if (std::strcmp(argv[i], "-r") == 0 && hasValue) {
+			options.seed = std::strtoull(argv[++i], nullptr, 0);
+		} else {
+			return false;
+		}
+	}
+	return options.ticks > 0 && options.worlds > 0 && options.threads > 0;
+}
+
+static void runWorld(const BenchOptions& options, BenchResult& result) {
+	World world = World(options.seed);
+	Simulation sim = Simulation(world, options.threads, options.deterministic);
+	world.config.moveModel = options.moveModel;
+	world.config.air = options.air;
+	world.config.heat = options.heat;
+	result.ok = buildScenario(world, options.scenario);
+	if (!result.ok) return;
+
+	result.startParts = world.parts.size();
+	result.particleTicks = 0;
+	result.removed = 0;
+	result.visited = 0;
+	result.sleeping = 0;
+	result.compactNs = 0;
+	result.reorderNs = 0;
+	result.airNs = 0;
+	result.heatNs = 0;
+	for (int i = 0; i < options.ticks; i++) {
+		sim.tick();
+		result.particleTicks += sim.stats.particles;
+		result.removed += sim.stats.removed;
+		result.visited += sim.stats.visited;
+		result.sleeping += sim.stats.sleeping;
+		result.compactNs += sim.stats.compactNs;
+		result.reorderNs += sim.stats.reorderNs;
+		result.airNs += sim.stats.airNs;
+		result.heatNs += sim.stats.heatNs;
+	}
+	result.endParts = world.parts.size();
+	result.checksum = world.checksum();
+	if (sim.getJobs() != nullptr) {
+		result.utilisation = sim.getJobs()->getUtilisation();
+	}
+}
+
+int main(int argc, char** argv) {
+	BenchOptions options = {
+		.scenario = "mixed",
+		.ticks = 1000,
+		.worlds = 1,
+		.threads = 1,
+		.deterministic = false,
+		.air = false,
+		.heat = false,
+		.moveModel = MoveModel::SEQUENTIAL,
+		.seed = ((uint64_t)std::random_device()() << 32) | std::random_device()()
+	};
+	if (!parseArgs(argc, argv, options)) {
+		usage();
+		return 1;
+	}
+
+	std::vector<BenchResult> results(options.worlds);
+	std::vector<std::thread> threads;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < options.worlds; i++) {
+		threads.emplace_back(runWorld, std::cref(options), std::ref(results[i]));
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	size_t startParts = 0;
+	size_t endParts = 0;
+	uint64_t particleTicks = 0;
+	uint64_t removed = 0;
+	uint64_t visited = 0;
+	uint64_t sleeping = 0;
+	uint64_t compactNs = 0;
+	uint64_t reorderNs = 0;
+	uint64_t airNs = 0;
+	uint64_t heatNs = 0;
+	for (BenchResult& result : results) {
+		if (!result.ok) return 1;
+		startParts += result.startParts;
+		endParts += result.endParts;
+		particleTicks += result.particleTicks;
+		removed += result.removed;
+		visited += result.visited;
+		sleeping += result.sleeping;
+		compactNs += result.compactNs;
+		reorderNs += result.reorderNs;
+		airNs += result.airNs;
+		heatNs += result.heatNs;
+	}
+
+	uint64_t ticks = (uint64_t)options.ticks * options.worlds;
+	double seconds = std::chrono::duration<double>(end - start).count();
+	double nanos = std::chrono::duration<double, std::nano>(end - start).count();
+	std::cout << "scenario:      " << options.scenario << std::endl;
+	std::cout << "worlds:        " << options.worlds << std::endl;
+	std::cout << "threads:       " << options.threads << (options.deterministic ? ", deterministic" : "") << std::endl;
+	std::cout << "moves:         " << (options.moveModel == MoveModel::INTENTS ? "intents" : "sequential") << std::endl;
+	std::cout << "seed:          " << options.seed << std::endl;
+#if defined(SANDBOX_FIXED_KINEMATICS)
+	std::cout << "kinematics:    fixed point" << std::endl;
+#else
+	std::cout << "kinematics:    float" << std::endl;
+#endif
+	std::cout << "ticks:         " << options.ticks << std::endl;
+	std::cout << "particles:     " << startParts << " -> " << endParts << std::endl;
+	std::cout << "elapsed:       " << seconds << " s" << std::endl;
+	std::cout << "ticks/sec:     " << ticks / seconds << std::endl;
+	std::cout << "ns/particle:   " << (particleTicks > 0 ? nanos / particleTicks : 0) << std::endl;
+	std::cout << "visited:       " << (particleTicks > 0 ? 100.0 * visited / particleTicks : 0) << " %" << std::endl;
+	std::cout << "asleep:        " << (particleTicks > 0 ? 100.0 * sleeping / particleTicks : 0) << " %" << std::endl;
+	std::cout << "removed:       " << removed << std::endl;
+	std::cout << "compaction:    " << compactNs / 1e6 << " ms total, " << compactNs / ticks << " ns/tick" << std::endl;
+	std::cout << "reorder:       " << reorderNs / 1e6 << " ms total, " << reorderNs / ticks << " ns/tick" << std::endl;
+	if (options.air) {
+		std::cout << "air:           " << airNs / 1e6 << " ms total, " << airNs / ticks << " ns/tick" << std::endl;
+	}
+	if (options.heat) {
+		std::cout << "heat:          " << heatNs / 1e6 << " ms total, " << heatNs / ticks << " ns/tick" << std::endl;
+	}
+	for (int i = 0; i < options.worlds; i++) {
+		std::cout << "checksum:      " << std::hex << results[i].checksum << std::dec << std::endl;
+	}
+	for (int i = 0; i < options.worlds; i++) {
+		if (results[i].utilisation.empty()) continue;
+		std::cout << "utilisation:  ";
+		for (double utilisation : results[i].utilisation) {
+			std::cout << " " << (int)(utilisation * 100) << "%";
+		}
+		std::cout << std::endl;
+	}
+	return 0;
+}
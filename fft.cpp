@@ -0,0 +1,77 @@
+#include <cmath>
+#include <utility>
+
+#include "sandbox.h"
+#include "fft.h"
+
+FFT::FFT(int size) : size(size), reversed(size), twiddles(size / 2) {
+	int bits = 0;
+	while ((1 << bits) < size) bits++;
+	for (int i = 0; i < size; i++) {
+		int r = 0;
+		for (int b = 0; b < bits; b++) {
+			if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+		}
+		this->reversed[i] = r;
+	}
+	for (int i = 0; i < size / 2; i++) {
+		this->twiddles[i] = std::polar(1.0f, -2 * PI * i / size);
+	}
+}
+
+void FFT::transform(std::complex<float>* data, bool inverse) const {
+	for (int i = 0; i < this->size; i++) {
+		if (i < this->reversed[i]) std::swap(data[i], data[this->reversed[i]]);
+	}
+	for (int len = 2; len <= this->size; len *= 2) {
+		int half = len / 2;
+		int stride = this->size / len;
+		for (int start = 0; start < this->size; start += len) {
+			for (int i = 0; i < half; i++) {
+				std::complex<float> twiddle = this->twiddles[i * stride];
+				if (inverse) twiddle = std::conj(twiddle);
+				std::complex<float> odd = data[start + i + half] * twiddle;
+				data[start + i + half] = data[start + i] - odd;
+				data[start + i] += odd;
+			}
+		}
+	}
+}
+
+int FFT::getSize() const {
+	return this->size;
+}
+
+FFT2D::FFT2D(int width, int height) : rows(width), columns(height), column(height) {
+}
+
+void FFT2D::transform(std::vector<std::complex<float>>& grid, bool inverse) {
+	int width = this->rows.getSize();
+	int height = this->columns.getSize();
+	for (int y = 0; y < height; y++) {
+		this->rows.transform(&grid[y * width], inverse);
+	}
+	for (int x = 0; x < width; x++) {
+		for (int y = 0; y < height; y++) {
+			this->column[y] = grid[y * width + x];
+		}
+		this->columns.transform(this->column.data(), inverse);
+		for (int y = 0; y < height; y++) {
+			grid[y * width + x] = this->column[y];
+		}
+	}
+	if (inverse) {
+		float scale = 1.0f / (width * height);
+		for (std::complex<float>& value : grid) {
+			value *= scale;
+		}
+	}
+}
+
+int FFT2D::getWidth() const {
+	return this->rows.getSize();
+}
+
+int FFT2D::getHeight() const {
+	return this->columns.getSize();
+}
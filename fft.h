@@ -0,0 +1,34 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+// Iterative radix-2 FFT over a power of two length. The inverse is left unscaled.
+class FFT {
+public:
+	FFT(int size);
+
+	void transform(std::complex<float>* data, bool inverse) const;
+	int getSize() const;
+
+private:
+	int size;
+	std::vector<int> reversed;
+	std::vector<std::complex<float>> twiddles;
+};
+
+// Transforms a row-major grid, rows first and then columns. Both sides must be powers
+// of two, and the inverse is scaled so it undoes the forward transform.
+class FFT2D {
+public:
+	FFT2D(int width, int height);
+
+	void transform(std::vector<std::complex<float>>& grid, bool inverse);
+	int getWidth() const;
+	int getHeight() const;
+
+private:
+	FFT rows;
+	FFT columns;
+	std::vector<std::complex<float>> column;
+};
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <cmath>
+
+#include "gravity.h"
+#include "particles.h"
+#include "world.h"
+
+GravityField::GravityField() : field(PIX_X * PIX_Y) {
+}
+
+void GravityField::addSource(const GravitySource& source) {
+	this->sources.push_back(source);
+	this->version++;
+	this->stale = true;
+}
+
+void GravityField::clearSources() {
+	this->sources.clear();
+	this->version++;
+	this->stale = true;
+}
+
+const std::vector<GravitySource>& GravityField::getSources() const {
+	return this->sources;
+}
+
+uint32_t GravityField::getVersion() const {
+	return this->version;
+}
+
+void GravityField::build() {
+	if (!this->stale) return;
+	std::fill(this->field.begin(), this->field.end(), olc::vf2d(0, 0));
+	for (const GravitySource& source : this->sources) {
+		if (source.type == ZONE) {
+			int x0 = std::max((int)source.pos.x, 0);
+			int y0 = std::max((int)source.pos.y, 0);
+			int x1 = std::min((int)(source.pos.x + source.size.x), PIX_X);
+			int y1 = std::min((int)(source.pos.y + source.size.y), PIX_Y);
+			for (int y = y0; y < y1; y++) {
+				for (int x = x0; x < x1; x++) {
+					this->field[y * PIX_X + x] += source.pull;
+				}
+			}
+			continue;
+		}
+		float sign = source.type == REPULSOR ? -1.0f : 1.0f;
+		for (int y = 0; y < PIX_Y; y++) {
+			for (int x = 0; x < PIX_X; x++) {
+				olc::vf2d toCentre = source.pos - olc::vf2d((float)x, (float)y);
+				float distance = toCentre.mag();
+				if (distance == 0) continue;
+				this->field[y * PIX_X + x] += toCentre / distance * std::min(source.strength, source.falloff / distance) * sign;
+			}
+		}
+	}
+	this->stale = false;
+}
+
+// Smallest change in pull that wakes the particles under a coarse cell, so a settled
+// scene can still sleep
+static constexpr float SELF_GRAVITY_WAKE = 0.001f;
+
+static constexpr int padToPowerOfTwo(int size) {
+	int padded = 1;
+	while (padded < 2 * size) padded *= 2;
+	return padded;
+}
+
+static constexpr int SELF_GRAVITY_FFT_X = padToPowerOfTwo(SELF_GRAVITY_X);
+static constexpr int SELF_GRAVITY_FFT_Y = padToPowerOfTwo(SELF_GRAVITY_Y);
+
+SelfGravity::SelfGravity() :
+	fft(SELF_GRAVITY_FFT_X, SELF_GRAVITY_FFT_Y),
+	kernel(SELF_GRAVITY_FFT_X * SELF_GRAVITY_FFT_Y),
+	work(SELF_GRAVITY_FFT_X * SELF_GRAVITY_FFT_Y),
+	field(SELF_GRAVITY_X * SELF_GRAVITY_Y) {
+	// Pull towards a unit mass at the origin, softened by one coarse cell so
+	// neighbouring cells don't see a singularity. Offsets past half way wrap to negative.
+	float softening = (float)(SELF_GRAVITY_CELL * SELF_GRAVITY_CELL);
+	for (int y = 0; y < SELF_GRAVITY_FFT_Y; y++) {
+		for (int x = 0; x < SELF_GRAVITY_FFT_X; x++) {
+			int dx = x < SELF_GRAVITY_FFT_X / 2 ? x : x - SELF_GRAVITY_FFT_X;
+			int dy = y < SELF_GRAVITY_FFT_Y / 2 ? y : y - SELF_GRAVITY_FFT_Y;
+			olc::vf2d offset = olc::vf2d((float)dx, (float)dy) * (float)SELF_GRAVITY_CELL;
+			float distSq = offset.mag2() + softening;
+			olc::vf2d pull = -offset / (distSq * std::sqrt(distSq));
+			this->kernel[y * SELF_GRAVITY_FFT_X + x] = std::complex<float>(pull.x, pull.y);
+		}
+	}
+	this->fft.transform(this->kernel, false);
+}
+
+void SelfGravity::solve(World& world, float strength) {
+	std::fill(this->work.begin(), this->work.end(), std::complex<float>(0, 0));
+	for (int32_t particle : world.parts) {
+		Type type = world.types[particle];
+		if (type == Type::NONE) continue;
+		float mass = getElement(type).mass;
+		if (mass <= 0) continue;
+		olc::vi2d pos = world.positions[particle];
+		this->work[(pos.y / SELF_GRAVITY_CELL) * SELF_GRAVITY_FFT_X + pos.x / SELF_GRAVITY_CELL] += mass;
+	}
+
+	// The masses are real, so one inverse transform gives the x pull in the real part
+	// and the y pull in the imaginary part
+	this->fft.transform(this->work, false);
+	for (size_t i = 0; i < this->work.size(); i++) {
+		this->work[i] *= this->kernel[i];
+	}
+	this->fft.transform(this->work, true);
+
+	for (int y = 0; y < SELF_GRAVITY_Y; y++) {
+		for (int x = 0; x < SELF_GRAVITY_X; x++) {
+			std::complex<float> pull = this->work[y * SELF_GRAVITY_FFT_X + x] * strength;
+			olc::vf2d& cell = this->field[y * SELF_GRAVITY_X + x];
+			olc::vf2d next = olc::vf2d(pull.real(), pull.imag());
+			if ((next - cell).mag2() > SELF_GRAVITY_WAKE * SELF_GRAVITY_WAKE) {
+				olc::vi2d min = olc::vi2d(x, y) * SELF_GRAVITY_CELL;
+				world.wakeArea(min, min + olc::vi2d(SELF_GRAVITY_CELL - 1, SELF_GRAVITY_CELL - 1));
+			}
+			cell = next;
+		}
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+#include "olcPixelGameEngine.h"
+#include "sandbox.h"
+#include "fft.h"
+
+class World;
+
+// Self gravity works on a coarse grid of SELF_GRAVITY_CELL cells square, padded to
+// powers of two at least twice its size so the FFT convolution does not wrap around
+static constexpr int SELF_GRAVITY_CELL = 4;
+static constexpr int SELF_GRAVITY_X = PIX_X / SELF_GRAVITY_CELL;
+static constexpr int SELF_GRAVITY_Y = PIX_Y / SELF_GRAVITY_CELL;
+
+enum GravitySourceType {
+	ATTRACTOR,
+	REPULSOR,
+	ZONE
+};
+
+typedef struct {
+	GravitySourceType type;
+	// Centre of an attractor or repulsor, or the top left corner of a zone, in cells
+	olc::vf2d pos;
+	// Extent of a zone in cells
+	olc::vf2d size;
+	// Pull everywhere inside a zone
+	olc::vf2d pull;
+	// Attractors and repulsors pull with falloff / distance, capped at strength
+	float strength;
+	float falloff;
+} GravitySource;
+
+static inline GravitySource makeAttractor(olc::vf2d pos, float strength, float falloff) {
+	return { ATTRACTOR, pos, olc::vf2d(), olc::vf2d(), strength, falloff };
+}
+
+static inline GravitySource makeRepulsor(olc::vf2d pos, float strength, float falloff) {
+	return { REPULSOR, pos, olc::vf2d(), olc::vf2d(), strength, falloff };
+}
+
+static inline GravitySource makeZone(olc::vf2d pos, olc::vf2d size, olc::vf2d pull) {
+	return { ZONE, pos, size, pull, 0, 0 };
+}
+
+// Gravity summed over a set of sources and cached per cell, so the tick samples one
+// vector per particle however many sources there are. Changing the sources marks the
+// field stale and the next build() recomputes it.
+class GravityField {
+public:
+	GravityField();
+
+	void addSource(const GravitySource& source);
+	void clearSources();
+	const std::vector<GravitySource>& getSources() const;
+	// Bumped whenever the sources change
+	uint32_t getVersion() const;
+
+	void build();
+
+	inline olc::vf2d sample(olc::vi2d pos) const {
+		return this->field[pos.y * PIX_X + pos.x];
+	}
+
+private:
+	std::vector<GravitySource> sources;
+	std::vector<olc::vf2d> field;
+	uint32_t version = 0;
+	bool stale = true;
+};
+
+// Newtonian gravity between the particles themselves. Masses are summed onto the coarse
+// grid and convolved with the pull of a unit mass, which costs two FFTs per solve no
+// matter how many particles there are.
+class SelfGravity {
+public:
+	SelfGravity();
+
+	// Particles under a cell whose pull moved noticeably since the last solve are woken
+	void solve(World& world, float strength);
+
+	inline olc::vf2d sample(olc::vi2d pos) const {
+		return this->field[(pos.y / SELF_GRAVITY_CELL) * SELF_GRAVITY_X + pos.x / SELF_GRAVITY_CELL];
+	}
+
+private:
+	FFT2D fft;
+	// Transform of the pull of a unit mass, x in the real part and y in the imaginary
+	std::vector<std::complex<float>> kernel;
+	std::vector<std::complex<float>> work;
+	std::vector<olc::vf2d> field;
+};
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "heat.h"
+#include "jobs.h"
+#include "particles.h"
+#include "world.h"
+
+// Diffusivity of empty cells
+static constexpr float AIR_DIFFUSIVITY = 0.2f;
+// Share of the gap to ambient every cell loses per tick
+static constexpr float HEAT_LOSS = 0.002f;
+// Smallest difference from ambient that keeps a band diffusing
+static constexpr float HEAT_WARM = 0.5f;
+// Limit of cells that never change
+static constexpr float NO_LIMIT = std::numeric_limits<float>::max();
+
+static constexpr int HEAT_CELLS = paddedSize(PIX_X, PIX_Y);
+
+static float getLimit(const Element& element) {
+	float limit = NO_LIMIT;
+	if (element.flammable && element.ignitionTemp > 0) limit = element.ignitionTemp;
+	if (element.boilTemp > 0) limit = std::min(limit, element.boilTemp);
+	return limit;
+}
+
+// One row of the stencil, returning how many cells end away from ambient
+static int diffuseRow(float* __restrict out, const float* __restrict t, const float* __restrict d, int stride) {
+	int warm = 0;
+	for (int x = 0; x < PIX_X; x++) {
+		float average = (t[x - 1] + t[x + 1] + t[x - stride] + t[x + stride]) * 0.25f;
+		float diffused = t[x] + (average - t[x]) * d[x];
+		out[x] = diffused + (AMBIENT_TEMP - diffused) * HEAT_LOSS;
+		warm += std::abs(out[x] - AMBIENT_TEMP) > HEAT_WARM;
+	}
+	return warm;
+}
+
+static int countAtLimit(const float* __restrict t, const float* __restrict limit) {
+	int count = 0;
+	for (int x = 0; x < PIX_X; x++) {
+		count += t[x] >= limit[x];
+	}
+	return count;
+}
+
+Heat::Heat() :
+	temperature(HEAT_CELLS, AMBIENT_TEMP),
+	next(HEAT_CELLS, AMBIENT_TEMP),
+	diffusivity(HEAT_CELLS, AIR_DIFFUSIVITY),
+	limit(HEAT_CELLS, NO_LIMIT),
+	hot(HEAT_BANDS),
+	warm(HEAT_BANDS),
+	active(HEAT_BANDS) {
+}
+
+void Heat::clear() {
+	std::fill(this->temperature.begin(), this->temperature.end(), AMBIENT_TEMP);
+	std::fill(this->next.begin(), this->next.end(), AMBIENT_TEMP);
+	std::fill(this->warm.begin(), this->warm.end(), false);
+}
+
+void Heat::step(World& world, JobSystem* jobs) {
+	// Cells changed since the last step are dirty now, or were dirty when this tick
+	// started. Skipping a step, or starting out, means everything has to be refreshed.
+	if (world.tick != this->lastTick + 1) {
+		refresh(world, olc::vi2d(0, 0), olc::vi2d(PIX_X - 1, PIX_Y - 1));
+	} else {
+		for (int chunk = 0; chunk < CHUNK_COUNT; chunk++) {
+			DirtyRect rect = merge(world.active[chunk], world.dirty[chunk]);
+			if (isEmpty(rect)) continue;
+			refresh(world, olc::vi2d(rect.minX, rect.minY), olc::vi2d(rect.maxX, rect.maxY));
+		}
+	}
+	this->lastTick = world.tick;
+
+	// Heat moves one cell per tick, so a band only changes if it or a neighbour is warm
+	for (int band = 0; band < HEAT_BANDS; band++) {
+		this->active[band] = this->warm[band] || (band > 0 && this->warm[band - 1]) || (band < HEAT_BANDS - 1 && this->warm[band + 1]);
+	}
+	runBands(jobs, PIX_Y, HEAT_BAND, [this](int band, int y0, int y1) {
+		diffuse(band, y0, y1);
+	});
+	std::swap(this->temperature, this->next);
+
+	// Bands are visited top to bottom so the result doesn't depend on the thread count
+	for (std::vector<olc::vi2d>& cells : this->hot) {
+		for (olc::vi2d pos : cells) {
+			transition(world, pos);
+		}
+	}
+}
+
+void Heat::refresh(const World& world, olc::vi2d min, olc::vi2d max) {
+	for (int y = min.y; y <= max.y; y++) {
+		for (int x = min.x; x <= max.x; x++) {
+			int32_t id = world.grid[y][x];
+			int i = index(x, y);
+			if (id == NO_PARTICLE) {
+				this->diffusivity[i] = AIR_DIFFUSIVITY;
+				this->limit[i] = NO_LIMIT;
+			} else {
+				const Element& element = getElement(world.types[id]);
+				this->diffusivity[i] = element.diffusivity;
+				this->limit[i] = getLimit(element);
+			}
+		}
+	}
+}
+
+void Heat::diffuse(int band, int y0, int y1) {
+	std::vector<olc::vi2d>& hot = this->hot[band];
+	hot.clear();
+	if (!this->active[band]) {
+		std::copy(&this->temperature[index(-1, y0)], &this->temperature[index(-1, y1)], &this->next[index(-1, y0)]);
+		return;
+	}
+	int warm = 0;
+	for (int y = y0; y < y1; y++) {
+		int row = index(0, y);
+		warm += diffuseRow(&this->next[row], &this->temperature[row], &this->diffusivity[row], STRIDE);
+		if (countAtLimit(&this->next[row], &this->limit[row]) == 0) continue;
+		for (int x = 0; x < PIX_X; x++) {
+			if (this->next[row + x] >= this->limit[row + x]) {
+				hot.push_back(olc::vi2d(x, y));
+			}
+		}
+	}
+	this->warm[band] = warm > 0;
+}
+
+void Heat::transition(World& world, olc::vi2d pos) {
+	int32_t id = world.grid[pos.y][pos.x];
+	if (id == NO_PARTICLE) return;
+	const Element& element = getElement(world.types[id]);
+	float temp = get(pos);
+	if (element.flammable && element.ignitionTemp > 0 && temp >= element.ignitionTemp) {
+		world.transmute(id, Type::FIRE);
+	} else if (element.boilTemp > 0 && temp >= element.boilTemp) {
+		world.remove(id);
+	}
+	refresh(world, pos, pos);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "olcPixelGameEngine.h"
+#include "sandbox.h"
+#include "stencil.h"
+
+class World;
+
+static constexpr float AMBIENT_TEMP = 22;
+// Rows diffused together, and skipped together while they and their neighbours are at
+// ambient temperature
+static constexpr int HEAT_BAND = 8;
+static constexpr int HEAT_BANDS = (PIX_Y + HEAT_BAND - 1) / HEAT_BAND;
+
+// Temperature of every cell, diffused each tick by an explicit stencil over a padded
+// grid whose border is at ambient temperature.
+class Heat {
+public:
+	Heat();
+
+	void clear();
+	// Diffuses one tick, rows split over the jobs when given, then ignites or boils
+	// the particles whose cells crossed their element's thresholds
+	void step(World& world, JobSystem* jobs);
+
+	inline float get(olc::vi2d pos) const {
+		return this->temperature[index(pos.x, pos.y)];
+	}
+
+	inline void raise(olc::vi2d pos, float temp) {
+		float& cell = this->temperature[index(pos.x, pos.y)];
+		cell = std::max(cell, temp);
+		this->warm[pos.y / HEAT_BAND] = true;
+	}
+
+private:
+	static constexpr int STRIDE = PIX_X + 2;
+
+	std::vector<float> temperature;
+	std::vector<float> next;
+	// Share of the gap to its neighbours' average each cell closes per tick, and the
+	// temperature at which the particle there ignites or boils. Both are refreshed only
+	// where cells changed since the last step.
+	std::vector<float> diffusivity;
+	std::vector<float> limit;
+	uint32_t lastTick = UINT32_MAX;
+	// Cells hot enough that some element there might change, per band of rows
+	std::vector<std::vector<olc::vi2d>> hot;
+	// Bands with a cell away from ambient, and the ones diffused this step
+	std::vector<uint8_t> warm;
+	std::vector<uint8_t> active;
+
+	static inline int index(int x, int y) {
+		return paddedIndex(x, y, PIX_X);
+	}
+
+	void refresh(const World& world, olc::vi2d min, olc::vi2d max);
+	void diffuse(int band, int y0, int y1);
+	void transition(World& world, olc::vi2d pos);
+};
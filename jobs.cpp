@@ -0,0 +1,140 @@
+#include <algorithm>
+
+#include "jobs.h"
+
+JobSystem::JobSystem(int threads) {
+	this->threads = std::max(threads, 1);
+	this->queues = std::make_unique<Queue[]>(this->threads);
+	resetStats();
+	for (int i = 1; i < this->threads; i++) {
+		this->workers.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->start.notify_all();
+	for (std::thread& worker : this->workers) {
+		worker.join();
+	}
+}
+
+int JobSystem::getThreads() const {
+	return this->threads;
+}
+
+void JobSystem::parallelFor(int count, const std::function<void(int)>& job) {
+	if (count <= 0) return;
+	{
+		// A worker that woke late for the last batch may still be looking for jobs
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->finished.wait(lock, [this] { return this->busy == 0; });
+
+		// Hand each worker a contiguous run, neighbouring chunks tend to cost the same
+		for (int i = 0; i < this->threads; i++) {
+			Queue& queue = this->queues[i];
+			std::lock_guard<std::mutex> queueLock(queue.mutex);
+			for (int index = (int)((int64_t)count * i / this->threads); index < (int64_t)count * (i + 1) / this->threads; index++) {
+				queue.jobs.push_back(index);
+			}
+		}
+		this->job = &job;
+		this->remaining = count;
+		this->generation++;
+	}
+	if (this->threads > 1) {
+		this->start.notify_all();
+	}
+	runJobs(0, job);
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->finished.wait(lock, [this] { return this->remaining == 0; });
+}
+
+void JobSystem::workerLoop(int self) {
+	uint64_t seen = 0;
+	while (true) {
+		const std::function<void(int)>* job;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->start.wait(lock, [this, seen] { return this->stopping || this->generation != seen; });
+			if (this->stopping) return;
+			seen = this->generation;
+			job = this->job;
+			this->busy++;
+		}
+		runJobs(self, *job);
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->busy--;
+		}
+		this->finished.notify_all();
+	}
+}
+
+// Runs jobs until every queue is empty, whoever finishes the last one wakes the caller
+void JobSystem::runJobs(int self, const std::function<void(int)>& job) {
+	WorkerStats& stats = this->queues[self].stats;
+	int index;
+	while (takeJob(self, index)) {
+		auto jobStart = std::chrono::steady_clock::now();
+		job(index);
+		stats.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - jobStart).count();
+		stats.jobs++;
+		if (this->remaining.fetch_sub(1) == 1) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->finished.notify_all();
+		}
+	}
+}
+
+// Takes from the back of our own queue, or failing that the front of someone else's
+bool JobSystem::takeJob(int self, int& index) {
+	{
+		Queue& own = this->queues[self];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.jobs.empty()) {
+			index = own.jobs.back();
+			own.jobs.pop_back();
+			return true;
+		}
+	}
+	for (int i = 1; i < this->threads; i++) {
+		Queue& victim = this->queues[(self + i) % this->threads];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty()) {
+			index = victim.jobs.front();
+			victim.jobs.pop_front();
+			this->queues[self].stats.steals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<WorkerStats> JobSystem::getStats() const {
+	std::vector<WorkerStats> stats;
+	for (int i = 0; i < this->threads; i++) {
+		stats.push_back(this->queues[i].stats);
+	}
+	return stats;
+}
+
+std::vector<double> JobSystem::getUtilisation() const {
+	double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->statsStart).count();
+	std::vector<double> utilisation;
+	for (int i = 0; i < this->threads; i++) {
+		utilisation.push_back(elapsed > 0 ? this->queues[i].stats.busyNs / elapsed : 0);
+	}
+	return utilisation;
+}
+
+void JobSystem::resetStats() {
+	for (int i = 0; i < this->threads; i++) {
+		this->queues[i].stats = {};
+	}
+	this->statsStart = std::chrono::steady_clock::now();
+}
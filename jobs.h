@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef struct {
+	uint64_t busyNs;
+	uint64_t jobs;
+	uint64_t steals;
+} WorkerStats;
+
+// Pool of worker threads for splitting a tick or a frame into chunk sized jobs. Each
+// worker has its own queue of jobs, and one that runs out takes jobs from the others,
+// so a few busy chunks don't leave the rest of the workers idle.
+class JobSystem {
+public:
+	// threads counts the calling thread, which runs jobs as worker 0 while it waits
+	JobSystem(int threads);
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	int getThreads() const;
+
+	// Runs job(i) for every i in [0, count) and returns once they have all finished
+	void parallelFor(int count, const std::function<void(int)>& job);
+
+	// Per worker counters since the last reset, only read them between parallelFor calls
+	std::vector<WorkerStats> getStats() const;
+	// Fraction of the time since the last reset each worker spent running jobs
+	std::vector<double> getUtilisation() const;
+	void resetStats();
+
+private:
+	typedef struct {
+		std::mutex mutex;
+		std::deque<int> jobs;
+		WorkerStats stats;
+	} Queue;
+
+	int threads;
+	std::unique_ptr<Queue[]> queues;
+	std::vector<std::thread> workers;
+	std::chrono::steady_clock::time_point statsStart;
+
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable finished;
+	bool stopping = false;
+	uint64_t generation = 0;
+
+	// The current batch of jobs. Workers take a copy of job when they pick up a
+	// generation, and busy counts the workers still looking for jobs from it.
+	const std::function<void(int)>* job = nullptr;
+	int busy = 0;
+	std::atomic<int> remaining = 0;
+
+	void workerLoop(int self);
+	void runJobs(int self, const std::function<void(int)>& job);
+	bool takeJob(int self, int& index);
+};
@@ -1,5 +1,7 @@
-#include <iostream>
 #include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
 
 #define OLC_PGE_APPLICATION
 #include "olcPixelGameEngine.h"
@@ -9,21 +11,6 @@
 #include "renderer.h"
 #include "particles.h"
 
-Config CONFIG = {
-	.gravType = VECTOR,
-	.gravVec = olc::vf2d(0, 0.05f),
-	.ticking = true
-};
-
-std::vector<ParticleState*> partArr = {};
-area_t partGrid = new ParticleState*[PIX_Y][PIX_X];
-
-static std::shared_ptr<Simulation> simulation;
-
-std::shared_ptr<Simulation> getSimulation() {
-	return simulation;
-}
-
 UIContext uiCtx = {
 	.types = std::vector<UIParticleType>(),
 	.selected = Type::DUST
@@ -31,26 +18,21 @@ UIContext uiCtx = {
 
 class Sandbox : public olc::PixelGameEngine {
 	float timeTillUpdate = 0;
-	std::shared_ptr<Simulation> sim = std::make_shared<Simulation>();
+	World world;
+	Simulation sim = Simulation(this->world, std::thread::hardware_concurrency());
 	Renderer renderer = Renderer();
 
 public:
-	Sandbox() {
+	Sandbox(uint64_t seed) : world(seed) {
 		this->sAppName = "Sandbox";
-		std::srand(std::time(NULL));
-
-		for (int y = 0; y < PIX_Y; y++) {
-			for (int x = 0; x < PIX_X; x++) {
-				partGrid[y][x] = nullptr;
-			}
-		}
+		std::cout << "Seed: " << seed << std::endl;
 
 		/*for (int y = 0; y < 50; y++) {
 			for (int x = 0; x < 50; x++) {
-				this->sim->add(olc::vi2d(x, y), Type::DUST);
+				this->world.add(olc::vi2d(x, y), Type::DUST);
 			}
 		}
-		CONFIG.ticking = false;*/
+		this->world.config.ticking = false;*/
 
 		for (int type = 0; type < NONE; type++) {
 			UIParticleType uiType = {
@@ -59,23 +41,22 @@ public:
 			};
 			uiCtx.types.push_back(uiType);
 		}
-
-		simulation = this->sim;
 	}
 
 	bool OnUserCreate() override {
+		this->renderer.jobs = this->sim.getJobs();
 		return true;
 	}
 
 	bool OnUserUpdate(float fElapsedTime) override {
-		this->renderer.renderArea(this);
-		this->renderer.renderUI(this);
+		this->renderer.renderArea(this, this->world);
+		this->renderer.renderUI(this, this->world);
 		bool update = false;
 		this->timeTillUpdate -= fElapsedTime;
 		if (this->timeTillUpdate <= 0) {
 			this->timeTillUpdate = std::max(0.0f, TICK_DURATION + this->timeTillUpdate);
-			if (CONFIG.ticking) {
-				this->sim->tick();
+			if (this->world.config.ticking) {
+				this->sim.tick();
 			}
 		}
 		handleInput();
@@ -98,7 +79,7 @@ private:
 						int dx = pixX - lastX;
 						int dy = pixY - lastY;
 
-						float length = std::max(1.0f, std::sqrtf(std::pow(dx, 2) + std::pow(dy, 2)));
+						float length = std::max(1.0f, std::sqrt((float)(dx * dx + dy * dy)));
 
 						float mx = (float)dx / length;
 						float my = (float)dy / length;
@@ -107,14 +88,17 @@ private:
 							int lx = (float)lastX + mx * t;
 							int ly = (float)lastY + my * t;
 							if (inBounds(lx, ly)) {
-								ParticleState* particle = partGrid[ly][lx];
-								if (GetMouse(0).bHeld && particle == nullptr) {
-									particle = this->sim->add(olc::vi2d(lx, ly), uiCtx.selected);
-									if (particle != nullptr && getProps(uiCtx.selected)->state == State::S_POWDER && rand() % 2 == 0) {
-										particle->deco = olc::Pixel(rand() % 256, rand() % 256, rand() % 256, rand() % 20);
+								int32_t particle = this->world.grid[ly][lx];
+								if (GetMouse(0).bHeld && particle == NO_PARTICLE) {
+									particle = this->world.add(olc::vi2d(lx, ly), uiCtx.selected);
+									if (particle != NO_PARTICLE && getElement(uiCtx.selected).state == State::S_POWDER) {
+										Random rng = Random(this->world.seed, this->world.tick, particle, RNG_DECO);
+										if (rng.nextInt(2) == 0) {
+											this->world.decos[particle] = olc::Pixel(rng.nextInt(256), rng.nextInt(256), rng.nextInt(256), rng.nextInt(20));
+										}
 									}
-								} else if (GetMouse(1).bHeld && particle != nullptr) {
-									this->sim->remove(particle);
+								} else if (GetMouse(1).bHeld && particle != NO_PARTICLE) {
+									this->world.remove(particle);
 								}
 							}
 						}
@@ -137,39 +121,76 @@ private:
 				}
 			}
 			if (GetKey(olc::Key::G).bPressed) {
-				switch (CONFIG.gravType) {
+				switch (this->world.config.gravType) {
 				case GravityType::VECTOR:
-					CONFIG.gravType = GravityType::RADIAL;
+					this->world.config.gravType = GravityType::RADIAL;
 					std::cout << "Gravity: Radial" << std::endl;
 					break;
 				case GravityType::RADIAL:
-					CONFIG.gravType = GravityType::OFF;
+					this->world.config.gravType = GravityType::FIELD;
+					std::cout << "Gravity: Field" << std::endl;
+					break;
+				case GravityType::FIELD:
+					this->world.config.gravType = GravityType::SELF;
+					std::cout << "Gravity: Self" << std::endl;
+					break;
+				case GravityType::SELF:
+					this->world.config.gravType = GravityType::OFF;
 					std::cout << "Gravity: Off" << std::endl;
 					break;
 				case GravityType::OFF:
 				default:
-					CONFIG.gravType = GravityType::VECTOR;
+					this->world.config.gravType = GravityType::VECTOR;
 					std::cout << "Gravity: Vector" << std::endl;
 				}
 			}
+			if (GetKey(olc::Key::M).bPressed) {
+				if (this->world.config.moveModel == MoveModel::SEQUENTIAL) {
+					this->world.config.moveModel = MoveModel::INTENTS;
+					std::cout << "Moves: Intents" << std::endl;
+				} else {
+					this->world.config.moveModel = MoveModel::SEQUENTIAL;
+					std::cout << "Moves: Sequential" << std::endl;
+				}
+			}
 			if (GetKey(olc::Key::C).bPressed) {
-				while (partArr.size() > 0) {
-					this->sim->remove(partArr.back());
+				this->world.clear();
+			}
+			// Field gravity sources: A attracts and R repels at the cursor, X removes them all
+			if (inBounds(pixX, pixY)) {
+				if (GetKey(olc::Key::A).bPressed) {
+					this->world.gravityField.addSource(makeAttractor(olc::vf2d((float)pixX, (float)pixY), 0.05f, 20));
+				}
+				if (GetKey(olc::Key::R).bPressed) {
+					this->world.gravityField.addSource(makeRepulsor(olc::vf2d((float)pixX, (float)pixY), 0.05f, 20));
 				}
 			}
+			if (GetKey(olc::Key::X).bPressed) {
+				this->world.gravityField.clearSources();
+			}
+			if (GetKey(olc::Key::P).bPressed) {
+				this->world.config.air = !this->world.config.air;
+				std::cout << "Air: " << (this->world.config.air ? "On" : "Off") << std::endl;
+			}
+			if (GetKey(olc::Key::H).bPressed) {
+				this->world.config.heat = !this->world.config.heat;
+				std::cout << "Heat: " << (this->world.config.heat ? "On" : "Off") << std::endl;
+			}
 			if (GetKey(olc::Key::SPACE).bPressed) {
-				CONFIG.ticking = !CONFIG.ticking;
+				this->world.config.ticking = !this->world.config.ticking;
 			}
 			if (GetKey(olc::Key::F).bPressed) {
-				CONFIG.ticking = false;
-				this->sim->tick();
+				this->world.config.ticking = false;
+				this->sim.tick();
 			}
 		}
 	}
 };
 
-int main() {
-	Sandbox game;
+// Pass a seed to replay a run
+int main(int argc, char** argv) {
+	uint64_t seed = argc > 1 ? std::strtoull(argv[1], nullptr, 0) : ((uint64_t)std::random_device()() << 32) | std::random_device()();
+	Sandbox game = Sandbox(seed);
 	if (game.Construct(WIDTH, HEIGHT + 40, 1, 1)) {
 		game.Start();
 	}
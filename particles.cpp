@@ -1,12 +1,47 @@
-#include <map>
+#include <algorithm>
+#include <array>
 
 #include "particles.h"
 
-std::map<Type, std::shared_ptr<ParticleProperties>> propertyLookup {
-	{ Type::DUST, std::make_shared<ParticleDust>() },
-	{ Type::WATER, std::make_shared<ParticleWater>() },
-	{ Type::BRICK, std::make_shared<ParticleBrick>() },
-	{ Type::ANAR, std::make_shared<ParticleAnar>() },
-	{ Type::GAS, std::make_shared<ParticleGas>() },
-	{ Type::FIRE, std::make_shared<ParticleFire>() }
-};
\ No newline at end of file
+static ParticleDust dust;
+static ParticleWater water;
+static ParticleBrick brick;
+static ParticleAnar anar;
+static ParticleGas gas;
+static ParticleFire fire;
+
+ParticleProperties* const propertyTable[Type::NONE] = {
+	&dust,
+	&water,
+	&brick,
+	&anar,
+	&gas,
+	&fire
+};
+
+static std::array<Element, Type::NONE> buildElementTable() {
+	std::array<Element, Type::NONE> table;
+	for (int type = 0; type < Type::NONE; type++) {
+		const ParticleProperties& props = *propertyTable[type];
+		table[type] = {
+			.state = props.state,
+			.flammable = props.flammable,
+			.hasUpdate = props.hasUpdate,
+			.reposeAngle = props.reposeAngle,
+			.mass = (float)props.mass,
+			.frictionCoeff = toCoefficient((float)props.frictionCoeff),
+			.dispersion = (float)props.dispersion,
+			.airDrag = (float)props.airDrag,
+			.airDragCoeff = toCoefficient((float)props.airDrag),
+			.airPressure = (float)props.airPressure,
+			.diffusivity = (float)std::min(props.conductivity / props.heatCapacity, 1.0),
+			.ignitionTemp = (float)props.ignitionTemp,
+			.boilTemp = (float)props.boilTemp,
+			.burnTemp = (float)props.burnTemp,
+			.colour = props.colour
+		};
+	}
+	return table;
+}
+
+const std::array<Element, Type::NONE> elementTable = buildElementTable();
\ No newline at end of file
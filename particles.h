@@ -1,14 +1,15 @@
 #pragma once
 
-#include <map>
+#include <array>
 #include <string>
+#include <vector>
 
 #include "olcPixelGameEngine.h"
+#include "rng.h"
 #include "sandbox.h"
-#include "renderer.h"
-#include "simulation.h"
+#include "world.h"
 
-enum State {
+enum State : uint8_t {
 	S_SOLID,
 	S_POWDER,
 	S_LIQUID,
@@ -28,21 +29,70 @@ public:
 
 	double dispersion = 0;
 
+	// Share of the gap between a particle's velocity and the wind closed each tick, and
+	// the pressure each particle adds to the air
+	double airDrag = 0;
+	double airPressure = 0;
+
+	// How fast heat crosses a particle, and how much it takes to warm it. A flammable
+	// particle catches fire once its cell reaches ignitionTemp and one with a boilTemp
+	// boils away, 0 for either never does. Burning particles hold their cell at burnTemp.
+	double conductivity = 0.2;
+	double heatCapacity = 1;
+	double ignitionTemp = 0;
+	double boilTemp = 0;
+	double burnTemp = 0;
+
 	olc::Pixel colour = olc::MAGENTA;
 
-	virtual void init(ParticleState* particle) {
+	// Set by elements that override update(), everything else skips the update pass
+	bool hasUpdate = false;
+
+	virtual void init(World& world, int32_t id) {
 	}
-	virtual void update(ParticleState* particle) {
+	// Called once per tick with the particles of this type in the regions changed last
+	// tick. Particles removed or transmuted earlier in the tick no longer have this type.
+	// A particle that keeps changing on its own must mark its cell dirty to be visited
+	// again.
+	virtual void update(World& world, const std::vector<int32_t>& batch) {
 	}
-	virtual olc::Pixel render(ParticleState* particle) {
+	virtual olc::Pixel render(const World& world, int32_t id) {
 		return this->colour;
 	};
 };
 
-extern std::map<Type, std::shared_ptr<ParticleProperties>> propertyLookup;
+// Scalar properties of each element, copied out of its ParticleProperties so the
+// hot paths can read them from one small table without touching the hook objects
+typedef struct {
+	State state;
+	bool flammable;
+	bool hasUpdate;
+	uint8_t reposeAngle;
+	float mass;
+	Coefficient frictionCoeff;
+	float dispersion;
+	float airDrag;
+	// The same drag applied to velocities, fixed point under SANDBOX_FIXED_KINEMATICS
+	Coefficient airDragCoeff;
+	float airPressure;
+	// Conductivity over heat capacity, the share of the gap to its neighbours' average
+	// temperature a particle's cell closes each tick
+	float diffusivity;
+	float ignitionTemp;
+	float boilTemp;
+	float burnTemp;
+	olc::Pixel colour;
+} Element;
+
+extern ParticleProperties* const propertyTable[Type::NONE];
+extern const std::array<Element, Type::NONE> elementTable;
+
+inline ParticleProperties& getProps(Type type) {
+	return *propertyTable[type];
+}
 
-inline std::shared_ptr<ParticleProperties> getProps(Type type) {
-	return propertyLookup[type];
+inline const Element& getElement(Type type) {
+	return elementTable[type];
 }
 
 class ParticleDust : public ParticleProperties {
@@ -53,6 +103,9 @@ public:
 		this->mass = 0.4;
 		this->frictionCoeff = 0.5;
 		this->reposeAngle = 45;
+		this->airDrag = 0.02;
+		this->conductivity = 0.3;
+		this->ignitionTemp = 150;
 		this->colour = olc::Pixel(0xff, 0xe0, 0xa0);
 		this->flammable = true;
 	}
@@ -66,23 +119,38 @@ public:
 		this->mass = 1;
 		this->frictionCoeff = 0.95;
 		this->reposeAngle = 0;
+		this->airDrag = 0.01;
+		this->conductivity = 0.5;
+		this->heatCapacity = 4;
+		this->boilTemp = 100;
 		this->colour = olc::Pixel(0x00, 0x00, 0xff);
+		this->hasUpdate = true;
 	}
 
-	olc::Pixel render(ParticleState* particle) override {
-		if (particle->data[0] > 0) {
+	olc::Pixel render(const World& world, int32_t id) override {
+		int32_t foam = world.data[id][0];
+		if (foam > 0) {
 			olc::Pixel brightest = olc::Pixel(0x88, 0x88, 0xff);
 			olc::Pixel dimmest = olc::Pixel(0x55, 0x55, 0xff);
-			return lerpPixel(this->colour, lerpPixel(dimmest, brightest, random()), (float)particle->data[0] / 1000);
+			Random rng = Random(world.seed, world.tick, id, RNG_RENDER);
+			return lerpPixel(this->colour, lerpPixel(dimmest, brightest, rng.nextFloat()), (float)foam / 1000);
 		}
 		return this->colour;
 	}
 
-	void update(ParticleState* state) override {
-		if (state->velocity.mag2() > 1) {
-			state->data[0] = std::min(state->data[0] + 10, 1000);
-		} else {
-			state->data[0] = std::max(state->data[0] - 20, 0);
+	void update(World& world, const std::vector<int32_t>& batch) override {
+		for (int32_t id : batch) {
+			if (world.types[id] != Type::WATER) continue;
+			int32_t& foam = world.data[id][0];
+			if (fromVelocity(world.velocities[id]).mag2() > 1) {
+				foam = std::min(foam + 10, 1000);
+			} else {
+				foam = std::max(foam - 20, 0);
+			}
+			if (foam > 0) {
+				// Keep fading and shimmering even once the water has settled
+				world.markDirty(world.positions[id], world.positions[id]);
+			}
 		}
 	}
 };
@@ -92,6 +160,8 @@ public:
 	ParticleBrick() {
 		this->name = "BRCK";
 		this->state = State::S_SOLID;
+		this->conductivity = 0.8;
+		this->heatCapacity = 2;
 		this->colour = olc::Pixel(0xaa, 0xaa, 0xaa);
 	}
 };
@@ -103,6 +173,7 @@ public:
 		this->state = State::S_POWDER;
 		this->mass = -0.4;
 		this->frictionCoeff = 0.5f;
+		this->airDrag = 0.02;
 		this->colour = olc::Pixel(0xff, 0xff, 0xff);
 	}
 };
@@ -114,6 +185,9 @@ public:
 		this->state = State::S_GAS;
 		this->mass = 0.0;
 		this->frictionCoeff = 0.95f;
+		this->airDrag = 0.3;
+		this->heatCapacity = 0.5;
+		this->ignitionTemp = 100;
 		this->colour = olc::Pixel(0xe4, 0xff, 0x35);
 		this->flammable = true;
 		this->dispersion = 1;
@@ -127,38 +201,55 @@ public:
 		this->state = State::S_GAS;
 		this->mass = -0.3;
 		this->frictionCoeff = 0.95f;
+		this->airDrag = 0.2;
+		this->airPressure = 0.01;
+		this->burnTemp = 600;
 		this->colour = olc::Pixel(0xff, 0x48, 0x30);
 		this->dispersion = 0.1;
+		this->hasUpdate = true;
 	}
 
-	void init(ParticleState* particle) override {
-		particle->data[0] = random() * 100 + 100;
+	void init(World& world, int32_t id) override {
+		Random rng = Random(world.seed, world.tick, id, RNG_INIT);
+		world.data[id][0] = rng.nextFloat() * 100 + 100;
 	}
 
-	void update(ParticleState* particle) override {
-		olc::vi2d pos = particle->pos;
-		for (int dy = -1; dy <= 1; dy++) {
-			for (int dx = -1; dx <= 1; dx++) {
-				if (dx == 0 && dy == 0) continue;
-				olc::vi2d checkPos = pos + olc::vi2d(dx, dy);
-				if (inBounds(checkPos)) {
-					ParticleState* check = partGrid[checkPos.y][checkPos.x];
-					if (check == nullptr) continue;
-					if (check->type != Type::NONE && getProps(check->type)->flammable) {
-						getSimulation()->remove(check);
-						getSimulation()->add(checkPos, Type::FIRE);
+	void update(World& world, const std::vector<int32_t>& batch) override {
+		for (int32_t id : batch) {
+			if (world.types[id] != Type::FIRE) continue;
+			olc::vi2d pos = world.positions[id];
+			if (world.config.heat) {
+				// Heat ignites the neighbours once it has spread to them
+				world.heat.raise(pos, (float)this->burnTemp);
+			} else if (world.neighboursChanged[id]) {
+				// Fire only spreads to what is around it when it is lit, when it moves, or when
+				// something moves in next to it. The rest of a burning region does no work.
+				for (int dy = -1; dy <= 1; dy++) {
+					for (int dx = -1; dx <= 1; dx++) {
+						if (dx == 0 && dy == 0) continue;
+						olc::vi2d checkPos = pos + olc::vi2d(dx, dy);
+						if (inBounds(checkPos)) {
+							int32_t check = world.grid[checkPos.y][checkPos.x];
+							if (check == NO_PARTICLE) continue;
+							if (getElement(world.types[check]).flammable) {
+								world.transmute(check, Type::FIRE);
+							}
+						}
 					}
 				}
+				world.neighboursChanged[id] = false;
+			}
+			if (--world.data[id][0] == 0) {
+				world.remove(id);
+			} else {
+				world.markDirty(pos, pos);
 			}
-		}
-		if (--particle->data[0] == 0) {
-			getSimulation()->remove(particle);
 		}
 	}
 
-	olc::Pixel render(ParticleState* particle) override {
+	olc::Pixel render(const World& world, int32_t id) override {
 		olc::Pixel brightest = olc::Pixel(0xff, 0x00, 0x00);
 		olc::Pixel dimmest = olc::Pixel(0x00, 0x00, 0x00);
-		return lerpPixel(dimmest, brightest, (float)particle->data[0] / 100);
+		return lerpPixel(dimmest, brightest, (float)world.data[id][0] / 100);
 	}
 };
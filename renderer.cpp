@@ -2,36 +2,44 @@
 #include "particles.h"
 #include "renderer.h"
 
-void Renderer::renderArea(olc::PixelGameEngine* ctx) {
-	ctx->FillRect(0, 0, WIDTH, HEIGHT, olc::BLANK);
-	for (int y = 0; y < PIX_Y; y++) {
-		for (int x = 0; x < PIX_X; x++) {
-			ParticleState* particle = partGrid[y][x];
-			if (particle != nullptr) {
-				ctx->FillRect(x * PIX_SIZE, y * PIX_SIZE, PIX_SIZE, PIX_SIZE, calculatePixel(particle));
-			}
+// Only redraws the regions changed since the last call, the rest of the draw target
+// still holds the previous frame. Chunks cover separate pixels so they can be drawn
+// in parallel.
+void Renderer::renderArea(olc::PixelGameEngine* ctx, World& world) {
+	this->dirtyChunks.clear();
+	for (int chunk = 0; chunk < CHUNK_COUNT; chunk++) {
+		world.renderDirty[chunk] = merge(world.renderDirty[chunk], world.dirty[chunk]);
+		if (!isEmpty(world.renderDirty[chunk])) {
+			this->dirtyChunks.push_back(chunk);
 		}
 	}
+	if (this->jobs != nullptr) {
+		this->jobs->parallelFor((int)this->dirtyChunks.size(), [this, ctx, &world](int i) {
+			renderRect(ctx, world, world.renderDirty[this->dirtyChunks[i]]);
+		});
+	} else {
+		for (int chunk : this->dirtyChunks) {
+			renderRect(ctx, world, world.renderDirty[chunk]);
+		}
+	}
+	for (int chunk : this->dirtyChunks) {
+		world.renderDirty[chunk] = NO_DIRTY;
+	}
 }
 
-uint8_t lerpCompAlpha(uint8_t a, uint8_t b, uint8_t alpha) {
-	return (uint32_t)b * alpha / 255 + (uint32_t)a * (255 - alpha) / 255;
-}
-
-olc::Pixel lerpPixel(olc::Pixel a, olc::Pixel b, float t) {
-	uint8_t tScaled = 255 * std::max(0.0f, std::min(1.0f, t));
-	olc::Pixel composited;
-	composited.a = lerpCompAlpha(a.a, b.a, tScaled);
-	composited.r = lerpCompAlpha(a.r, b.r, tScaled);
-	composited.g = lerpCompAlpha(a.g, b.g, tScaled);
-	composited.b = lerpCompAlpha(a.b, b.b, tScaled);
-	return composited;
+void Renderer::renderRect(olc::PixelGameEngine* ctx, const World& world, const DirtyRect& rect) {
+	for (int y = rect.minY; y <= rect.maxY; y++) {
+		for (int x = rect.minX; x <= rect.maxX; x++) {
+			int32_t id = world.grid[y][x];
+			olc::Pixel colour = id == NO_PARTICLE ? olc::BLANK : calculatePixel(world, id);
+			ctx->FillRect(x * PIX_SIZE, y * PIX_SIZE, PIX_SIZE, PIX_SIZE, colour);
+		}
+	}
 }
 
-olc::Pixel Renderer::calculatePixel(ParticleState* particle) {
-	std::shared_ptr<ParticleProperties> properties = propertyLookup[particle->type];
-	olc::Pixel colour = properties->render(particle);
-	olc::Pixel& deco = particle->deco;
+olc::Pixel Renderer::calculatePixel(const World& world, int32_t id) {
+	olc::Pixel colour = getProps(world.types[id]).render(world, id);
+	const olc::Pixel& deco = world.decos[id];
 	olc::Pixel composited;
 	composited.a = 0xff;
 	composited.r = lerpCompAlpha(colour.r, deco.r, deco.a);
@@ -40,19 +48,18 @@ olc::Pixel Renderer::calculatePixel(ParticleState* particle) {
 	return composited;
 }
 
-void Renderer::renderUI(olc::PixelGameEngine* ctx) {
+void Renderer::renderUI(olc::PixelGameEngine* ctx, const World& world) {
 	int windowHeight = ctx->GetDrawTargetHeight();
 	ctx->FillRect(0, HEIGHT, WIDTH, windowHeight - HEIGHT + 1, olc::BLANK);
 	ctx->FillRect(0, HEIGHT, WIDTH, 4, olc::GREY);
 	for (auto& type : uiCtx.types) {
-		std::shared_ptr<ParticleProperties> properties = propertyLookup[type.type];
-		ctx->FillRect(type.uiPos, olc::vi2d(30, 20), properties->colour);
+		ctx->FillRect(type.uiPos, olc::vi2d(30, 20), getElement(type.type).colour);
 		if (type.type == uiCtx.selected) {
 			ctx->DrawRect(olc::vi2d(type.uiPos.x - 1, type.uiPos.y - 1), olc::vi2d(31, 21), olc::RED);
 			ctx->DrawRect(olc::vi2d(type.uiPos.x - 2, type.uiPos.y - 2), olc::vi2d(33, 23), olc::RED);
 		}
 	}
-	if (!CONFIG.ticking) {
+	if (!world.config.ticking) {
 		ctx->FillRect(WIDTH - 15, windowHeight - 20, 4, 14, olc::WHITE);
 		ctx->FillRect(WIDTH - 9, windowHeight - 20, 4, 14, olc::WHITE);
 	}
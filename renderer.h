@@ -1,16 +1,25 @@
 #pragma once
 
+#include <vector>
+
+#include "jobs.h"
 #include "olcPixelGameEngine.h"
 #include "sandbox.h"
+#include "world.h"
 
 class Renderer {
 public:
-	void renderArea(olc::PixelGameEngine* ctx);
+	// Shared with the simulation to draw chunks in parallel, drawn serially if unset
+	JobSystem* jobs = nullptr;
+
+	void renderArea(olc::PixelGameEngine* ctx, World& world);
+
+	void renderUI(olc::PixelGameEngine* ctx, const World& world);
 
-	void renderUI(olc::PixelGameEngine* ctx);
+	olc::Pixel calculatePixel(const World& world, int32_t id);
 
-	olc::Pixel calculatePixel(ParticleState* particle);
-};
+private:
+	std::vector<int> dirtyChunks;
 
-uint8_t lerpCompAlpha(uint8_t a, uint8_t b, uint8_t alpha);
-olc::Pixel lerpPixel(olc::Pixel a, olc::Pixel b, float t);
\ No newline at end of file
+	void renderRect(olc::PixelGameEngine* ctx, const World& world, const DirtyRect& rect);
+};
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+// Call sites that draw random numbers, each gets an independent stream
+enum RandomStream : uint32_t {
+	RNG_INIT,
+	RNG_REPOSE,
+	RNG_DISPERSE,
+	RNG_RENDER,
+	RNG_DECO,
+	RNG_INTENT
+};
+
+static inline uint64_t mixBits(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+// Counter-based generator: every value is a hash of (seed, tick, particle id, stream,
+// draw number), so there is no shared state to race on and any draw can be replayed
+// from the seed.
+class Random {
+public:
+	Random(uint64_t seed, uint32_t tick, uint32_t id, RandomStream stream) {
+		this->key = mixBits(mixBits(seed + (uint64_t)stream * 0x9e3779b97f4a7c15ULL) ^ ((uint64_t)tick << 32 | id));
+	}
+
+	uint32_t next() {
+		return (uint32_t)(mixBits(this->key + ++this->counter * 0x9e3779b97f4a7c15ULL) >> 32);
+	}
+
+	// Uniform in [0, 1)
+	float nextFloat() {
+		return (next() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// Uniform in [0, n)
+	int nextInt(int n) {
+		return (int)(((uint64_t)next() * (uint32_t)n) >> 32);
+	}
+
+private:
+	uint64_t key;
+	uint32_t counter = 0;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
-#include <random>
+#include <array>
+#include <cmath>
 #include <vector>
 
 #include "olcPixelGameEngine.h"
@@ -13,22 +14,55 @@ static constexpr int PIX_Y = HEIGHT / PIX_SIZE;
 static constexpr float PI = 3.141592f;
 static constexpr float TICK_DURATION = 1.0f / 60.0f;
 static constexpr int MAX_PARTS = 100000;
-
+static constexpr int PART_DATA_SIZE = 10;
+static constexpr int32_t NO_PARTICLE = -1;
+// Sub-cell offsets are 16.16 fixed point
+static constexpr int SUBCELL_BITS = 16;
+static constexpr int32_t SUBCELL_ONE = 1 << SUBCELL_BITS;
+// A particle blocked on this many move attempts in a row is put to sleep
+static constexpr uint8_t SLEEP_ATTEMPTS = 3;
+// The grid is split into square chunks, each tracking the rectangle changed within it
+static constexpr int CHUNK_SIZE = 32;
+static constexpr int CHUNKS_X = (PIX_X + CHUNK_SIZE - 1) / CHUNK_SIZE;
+static constexpr int CHUNKS_Y = (PIX_Y + CHUNK_SIZE - 1) / CHUNK_SIZE;
+static constexpr int CHUNK_COUNT = CHUNKS_X * CHUNKS_Y;
+
+// RADIAL pulls towards the centre of the grid, FIELD samples the sources added to the
+// world's gravity field, and SELF pulls particles towards each other by mass
 enum GravityType {
 	VECTOR,
 	RADIAL,
-	OFF
+	OFF,
+	FIELD,
+	SELF
+};
+
+// SEQUENTIAL moves each particle straight into the grid, one after another. INTENTS
+// plans every move against the grid as it was at the start of the tick, then applies
+// them, with clashes over a cell settled by a per-tick priority.
+enum MoveModel {
+	SEQUENTIAL,
+	INTENTS
 };
 
 typedef struct {
 	GravityType gravType;
 	olc::vf2d gravVec;
 	bool ticking;
+	MoveModel moveModel;
+	// Ticks between renumbering particles in grid order, 0 never does
+	uint32_t reorderInterval;
+	// Ticks between self gravity solves, and the pull between two unit masses one cell apart
+	uint32_t selfGravityInterval;
+	float selfGravityStrength;
+	// Step the air every tick and let particles push it and drift with it
+	bool air;
+	// Diffuse heat every tick and let it ignite and boil particles, instead of fire
+	// igniting its flammable neighbours directly
+	bool heat;
 } Config;
 
-extern Config CONFIG;
-
-typedef enum {
+typedef enum : uint8_t {
 	DUST,
 	WATER,
 	BRICK,
@@ -38,16 +72,6 @@ typedef enum {
 	NONE
 } Type;
 
-typedef struct {
-	Type type;
-	olc::vi2d pos;
-	olc::vf2d velocity;
-	olc::vf2d delta;
-	olc::Pixel deco;
-	int32_t data[10];
-	bool dead;
-} ParticleState;
-
 typedef struct {
 	olc::vi2d uiPos;
 	Type type;
@@ -60,19 +84,69 @@ typedef struct {
 
 extern UIContext uiCtx;
 
-typedef ParticleState*(*area_t)[PIX_X];
+typedef int32_t(*area_t)[PIX_X];
+typedef std::array<int32_t, PART_DATA_SIZE> PartData;
+
+
+static inline olc::vi2d toSubcell(olc::vf2d v) {
+	return olc::vi2d((int32_t)(v.x * SUBCELL_ONE), (int32_t)(v.y * SUBCELL_ONE));
+}
+
+// Velocities are in cells per tick. Defining SANDBOX_FIXED_KINEMATICS stores them, and
+// the coefficients they are scaled by, as 16.16 fixed point like the sub-cell offsets,
+// so integration is integer only and bit-reproducible across compilers. The gravity
+// fields, air and heat are still computed in float, so runs that use them are only
+// reproducible with the same build.
+#if defined(SANDBOX_FIXED_KINEMATICS)
+typedef olc::vi2d Velocity;
+typedef int32_t Coefficient;
+
+static inline Velocity toVelocity(olc::vf2d v) {
+	return toSubcell(v);
+}
+
+static inline olc::vf2d fromVelocity(Velocity v) {
+	return olc::vf2d((float)v.x, (float)v.y) / (float)SUBCELL_ONE;
+}
+
+static inline olc::vi2d velocityToSubcell(Velocity v) {
+	return v;
+}
+
+static inline Coefficient toCoefficient(float c) {
+	return (Coefficient)std::lround(c * SUBCELL_ONE);
+}
+
+// Divides rather than shifts so both signs round towards zero, like the float product
+// shrinking to nothing
+static inline Velocity scaleVelocity(Velocity v, Coefficient c) {
+	return olc::vi2d((int32_t)((int64_t)v.x * c / SUBCELL_ONE), (int32_t)((int64_t)v.y * c / SUBCELL_ONE));
+}
+#else
+typedef olc::vf2d Velocity;
+typedef float Coefficient;
 
-extern std::vector<ParticleState*> partArr;
-extern area_t partGrid;
+static inline Velocity toVelocity(olc::vf2d v) {
+	return v;
+}
 
+static inline olc::vf2d fromVelocity(Velocity v) {
+	return v;
+}
 
-static float random() {
-	static std::random_device rd;
-	static std::mt19937 e2(rd());
-	static std::uniform_real_distribution<> dist(0, 1);
-	return dist(e2);
+static inline olc::vi2d velocityToSubcell(Velocity v) {
+	return toSubcell(v);
 }
 
+static inline Coefficient toCoefficient(float c) {
+	return c;
+}
+
+static inline Velocity scaleVelocity(Velocity v, Coefficient c) {
+	return v * c;
+}
+#endif
+
 static inline float toRads(float degrees) {
 	return degrees * (PI / 180);
 }
@@ -83,4 +157,18 @@ static bool inBounds(int x, int y) {
 
 static bool inBounds(olc::vi2d pos) {
 	return pos.x >= 0 && pos.x < PIX_X && pos.y >= 0 && pos.y < PIX_Y;
+}
+
+inline uint8_t lerpCompAlpha(uint8_t a, uint8_t b, uint8_t alpha) {
+	return (uint32_t)b * alpha / 255 + (uint32_t)a * (255 - alpha) / 255;
+}
+
+inline olc::Pixel lerpPixel(olc::Pixel a, olc::Pixel b, float t) {
+	uint8_t tScaled = 255 * std::max(0.0f, std::min(1.0f, t));
+	olc::Pixel composited;
+	composited.a = lerpCompAlpha(a.a, b.a, tScaled);
+	composited.r = lerpCompAlpha(a.r, b.r, tScaled);
+	composited.g = lerpCompAlpha(a.g, b.g, tScaled);
+	composited.b = lerpCompAlpha(a.b, b.b, tScaled);
+	return composited;
 }
\ No newline at end of file
@@ -1,3 +1,9 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
 #include <vector>
 
 #include "olcPixelGameEngine.h"
@@ -10,213 +16,715 @@ void clip(olc::vi2d& pos) {
 	pos.y = std::min(std::max(pos.y, 0), HEIGHT - 1);
 }
 
-void handleFriction(ParticleState* particle) {
-	std::shared_ptr<ParticleProperties> properties = propertyLookup[particle->type];
-	particle->velocity *= properties->frictionCoeff;
+// Repose candidates are the neighbour cells at 15 degree steps either side of the
+// direction of travel. Directions are quantised to 7.5 degrees, so each candidate is
+// a fixed index offset into one table of neighbour offsets, and the direction itself
+// comes from a lookup on the velocity scaled onto a small integer grid.
+static constexpr int DIR_STEPS = 48;
+static constexpr int DIR_PER_REPOSE_STEP = 2;
+static constexpr int DIR_GRID = 16;
+
+typedef struct {
+	olc::vi2d offsets[DIR_STEPS];
+	uint8_t directions[2 * DIR_GRID + 1][2 * DIR_GRID + 1];
+} ReposeTable;
+
+static ReposeTable buildReposeTable() {
+	ReposeTable table;
+	float step = 2 * PI / DIR_STEPS;
+	for (int i = 0; i < DIR_STEPS; i++) {
+		olc::vf2d offset = olc::vf2d(1.42f, i * step).cart();
+		table.offsets[i] = olc::vi2d((int)std::floor(0.5f + offset.x), (int)std::floor(0.5f + offset.y));
+	}
+	for (int y = -DIR_GRID; y <= DIR_GRID; y++) {
+		for (int x = -DIR_GRID; x <= DIR_GRID; x++) {
+			int dir = (int)std::lround(std::atan2((float)y, (float)x) / step);
+			table.directions[y + DIR_GRID][x + DIR_GRID] = (dir + DIR_STEPS) % DIR_STEPS;
+		}
+	}
+	return table;
+}
+
+static const ReposeTable reposeTable = buildReposeTable();
+
+static int quantiseDirection(olc::vf2d v) {
+	float extent = std::max(std::abs(v.x), std::abs(v.y));
+	float scale = DIR_GRID / extent;
+	int x = (int)(v.x * scale + DIR_GRID + 0.5f);
+	int y = (int)(v.y * scale + DIR_GRID + 0.5f);
+	return reposeTable.directions[y][x];
+}
+
+// In a parallel tick, chunks in the same phase are one chunk apart, so each may reach
+// half way into the chunks around it. A particle's walk is capped to leave room for a
+// repose step, a dispersal step and the ring of cells woken around where it lands.
+static constexpr int PARALLEL_MAX_STEP = CHUNK_SIZE / 2 - 3;
+
+static constexpr uint64_t NO_CLAIM = UINT64_MAX;
+
+// Lowest claim on a cell wins. The high bits reshuffle every tick so no direction or
+// element is favoured, and the id in the low bits breaks ties.
+static uint64_t intentPriority(const World& world, int32_t particle) {
+	uint64_t shuffle = Random(world.seed, world.tick, particle, RNG_INTENT).next();
+	return (shuffle << 32) | (uint32_t)particle;
+}
+
+static uint64_t nanosSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+Simulation::Simulation(World& world, int threads, bool deterministic) :
+	world(world),
+	visiting((MAX_PARTS + 63) / 64),
+	intents(MAX_PARTS),
+	claims(PIX_X * PIX_Y, NO_CLAIM) {
+	this->lastGravType = world.config.gravType;
+	this->lastGravVec = world.config.gravVec;
+	this->lastFieldVersion = world.gravityField.getVersion();
+	setThreads(threads, deterministic);
+}
+
+void Simulation::setThreads(int threads, bool deterministic) {
+	if (threads > 1 || deterministic) {
+		this->jobs = std::make_unique<JobSystem>(threads);
+		this->batches.resize(CHUNK_COUNT);
+		this->maxStep = PARALLEL_MAX_STEP;
+	} else {
+		this->jobs = nullptr;
+		this->batches.resize(1);
+		this->maxStep = std::numeric_limits<int>::max();
+	}
+}
+
+int Simulation::getThreads() const {
+	return this->jobs == nullptr ? 1 : this->jobs->getThreads();
+}
+
+bool Simulation::isChunked() const {
+	return this->jobs != nullptr;
+}
+
+JobSystem* Simulation::getJobs() {
+	return this->jobs.get();
 }
 
 void Simulation::tick() {
-	std::vector<ParticleState*> toUpdate = partArr;
-	for (ParticleState* particle : toUpdate) {
-		if (particle->dead) continue;
-		std::shared_ptr<ParticleProperties> properties = getProps(particle->type);
-		switch (properties->state) {
-		case State::S_POWDER:
-			updatePowder(particle);
-			break;
-		case State::S_LIQUID:
-			updateLiquid(particle);
-			break;
-		case State::S_GAS:
-			updateGas(particle);
-			break;
-		}
-		properties->update(particle);
+	auto start = std::chrono::steady_clock::now();
+	this->stats.particles = (int)this->world.parts.size();
+
+	// Particles removed mid-tick are tombstoned and reclaimed in one pass at the end,
+	// so ids stay stable. Particles spawned mid-tick first update next tick.
+	this->world.deferRemovals = true;
+
+	GravityType gravType = this->world.config.gravType;
+	uint32_t fieldVersion = this->world.gravityField.getVersion();
+	bool gravChanged = gravType != this->lastGravType || this->world.config.gravVec != this->lastGravVec || fieldVersion != this->lastFieldVersion;
+	if (gravChanged) {
+		this->world.wakeAll();
+		this->lastGravType = gravType;
+		this->lastGravVec = this->world.config.gravVec;
+		this->lastFieldVersion = fieldVersion;
 	}
-	for (int i = 0; i < partArr.size(); i++) {
-		ParticleState* particle = partArr[i];
-		if (particle->dead) {
-			partArr.erase(partArr.begin() + i--);
+	// Fields are only rebuilt after their sources change, and never during the tick
+	if (gravType == GravityType::RADIAL) this->world.radialField.build();
+	else if (gravType == GravityType::FIELD) this->world.gravityField.build();
+	else if (gravType == GravityType::SELF) updateSelfGravity(gravChanged);
+
+	// The air steps before anything moves so the wind it wakes is visited this tick
+	this->stats.airNs = 0;
+	if (this->world.config.air) {
+		auto airStart = std::chrono::steady_clock::now();
+		this->world.air.step(this->world, this->jobs.get());
+		this->stats.airNs += nanosSince(airStart);
+	}
+
+	// Only the chunk regions changed last tick are visited. Anything that changes a cell
+	// marks its neighbourhood dirty, and awake particles mark their own cell, so the rest
+	// of the world is known to be at rest.
+	this->world.swapDirty();
+
+	// Collect the particles in those regions as a set of ids, and read it back in id
+	// order so the batches walk the particle columns front to back
+	for (const DirtyRect& rect : this->world.active) {
+		if (isEmpty(rect)) continue;
+		this->changedSinceReorder = true;
+		for (int y = rect.minY; y <= rect.maxY; y++) {
+			for (int x = rect.minX; x <= rect.maxX; x++) {
+				int32_t particle = this->world.grid[y][x];
+				if (particle == NO_PARTICLE) continue;
+				this->visiting[particle >> 6] |= 1ull << (particle & 63);
+			}
 		}
 	}
-}
 
-bool Simulation::tryPlace(ParticleState* particle, olc::vi2d newPos) {
-	if (particle->pos == newPos) return false;
-	std::shared_ptr<ParticleProperties> props = getProps(particle->type);
+	// Bucket the visited particles by type so each element's physics and update hook run
+	// over one contiguous batch. Solids have no physics and sleeping particles are left
+	// out until something next to them changes.
+	bool parallel = this->jobs != nullptr;
+	for (TypeBatches& chunkBatches : this->batches) {
+		for (std::vector<int32_t>& batch : chunkBatches) {
+			batch.clear();
+		}
+	}
+	for (std::vector<int32_t>& batch : this->hookBatches) {
+		batch.clear();
+	}
+	int visited = 0;
+	int sleeping = 0;
+	for (int word = 0; word < (int)this->visiting.size(); word++) {
+		uint64_t bits = this->visiting[word];
+		if (bits == 0) continue;
+		this->visiting[word] = 0;
+		while (bits != 0) {
+			int32_t particle = word * 64 + std::countr_zero(bits);
+			bits &= bits - 1;
+			Type type = this->world.types[particle];
+			const Element& element = getElement(type);
+			visited++;
+			if (element.hasUpdate) {
+				this->hookBatches[type].push_back(particle);
+			}
+			if (element.state == State::S_SOLID) continue;
+			if (this->world.isAsleep(particle)) {
+				sleeping++;
+				continue;
+			}
+			int chunk = 0;
+			if (parallel) {
+				olc::vi2d pos = this->world.positions[particle];
+				chunk = (pos.y / CHUNK_SIZE) * CHUNKS_X + pos.x / CHUNK_SIZE;
+			}
+			this->batches[chunk][type].push_back(particle);
+		}
+	}
+	this->stats.visited = visited;
+	this->stats.sleeping = sleeping;
 
-	if (inBounds(newPos)) {
-		ParticleState* newParticle = partGrid[newPos.y][newPos.x];
-		bool canSwap = false;
-		if (newParticle == nullptr) {
-			canSwap = true;
-		} else {
-			std::shared_ptr<ParticleProperties> newProps = getProps(newParticle->type);
-			if (props->state < newProps->state) {
-				canSwap = true;
+	if (this->world.config.moveModel == MoveModel::INTENTS) {
+		moveByIntents(gravType);
+		for (int type = 0; type < Type::NONE; type++) {
+			if (!this->hookBatches[type].empty()) {
+				getProps((Type)type).update(this->world, this->hookBatches[type]);
 			}
 		}
-		if (canSwap) {
-			if (newParticle == nullptr) {
-				partGrid[newPos.y][newPos.x] = particle;
-				partGrid[particle->pos.y][particle->pos.x] = nullptr;
-				particle->pos = newPos;
-			} else {
-				partGrid[newPos.y][newPos.x] = particle;
-				partGrid[particle->pos.y][particle->pos.x] = newParticle;
-				newParticle->pos = particle->pos;
-				particle->pos = newPos;
+	} else if (!parallel) {
+		for (int type = 0; type < Type::NONE; type++) {
+			const Element& element = getElement((Type)type);
+			const std::vector<int32_t>& batch = this->batches[0][type];
+			if (!batch.empty()) {
+				BatchKernel kernel = getKernel(gravType, element.state, false);
+				if (kernel != nullptr) {
+					(this->*kernel)(batch, element);
+				}
+			}
+			if (!this->hookBatches[type].empty()) {
+				getProps((Type)type).update(this->world, this->hookBatches[type]);
+			}
+		}
+	} else {
+		// Chunks in one phase never touch the same cells, so they can run on any thread in
+		// any order and the result only depends on the phase order. Within a chunk the
+		// particles run by type then id, ids being handed out in the order particles were
+		// added. The update hooks add and remove particles, so they run afterwards on this
+		// thread in the same order.
+		for (std::vector<int>& phase : this->phases) {
+			phase.clear();
+		}
+		for (int chunk = 0; chunk < CHUNK_COUNT; chunk++) {
+			const TypeBatches& chunkBatches = this->batches[chunk];
+			bool empty = std::all_of(chunkBatches.begin(), chunkBatches.end(), [](const std::vector<int32_t>& batch) {
+				return batch.empty();
+			});
+			if (empty) continue;
+			int cx = chunk % CHUNKS_X;
+			int cy = chunk / CHUNKS_X;
+			this->phases[(cy % 2) * 2 + cx % 2].push_back(chunk);
+		}
+		for (const std::vector<int>& phase : this->phases) {
+			this->jobs->parallelFor((int)phase.size(), [this, &phase, gravType](int i) {
+				dropDisplaced(phase[i]);
+				runBatches(this->batches[phase[i]], gravType, false);
+			});
+		}
+		for (int type = 0; type < Type::NONE; type++) {
+			if (!this->hookBatches[type].empty()) {
+				getProps((Type)type).update(this->world, this->hookBatches[type]);
 			}
-			return true;
 		}
-		return false;
 	}
-	return false;
+	if (this->world.config.air) {
+		auto airStart = std::chrono::steady_clock::now();
+		pushAir();
+		this->stats.airNs += nanosSince(airStart);
+	}
+	// Heat spreads after the fire hooks have heated their cells, and anything it ignites
+	// first burns next tick
+	this->stats.heatNs = 0;
+	if (this->world.config.heat) {
+		auto heatStart = std::chrono::steady_clock::now();
+		this->world.heat.step(this->world, this->jobs.get());
+		this->stats.heatNs = nanosSince(heatStart);
+	}
+	this->world.deferRemovals = false;
+
+	auto compactStart = std::chrono::steady_clock::now();
+	this->stats.removed = this->world.compact();
+	this->world.tick++;
+	this->stats.compactNs = nanosSince(compactStart);
+
+	// A world where nothing has changed since the last renumbering is still in order
+	this->stats.reorderNs = 0;
+	uint32_t interval = this->world.config.reorderInterval;
+	if (interval != 0 && this->world.tick % interval == 0 && this->changedSinceReorder) {
+		auto reorderStart = std::chrono::steady_clock::now();
+		this->world.reorder();
+		this->changedSinceReorder = false;
+		this->stats.reorderNs = nanosSince(reorderStart);
+	}
+	this->stats.tickNs = nanosSince(start);
 }
 
-void Simulation::updatePhysicsParticle(ParticleState* particle) {
-	std::shared_ptr<ParticleProperties> properties = getProps(particle->type);
+void Simulation::runBatches(const TypeBatches& batches, GravityType gravType, bool intents) {
+	for (int type = 0; type < Type::NONE; type++) {
+		const std::vector<int32_t>& batch = batches[type];
+		if (batch.empty()) continue;
+		const Element& element = getElement((Type)type);
+		BatchKernel kernel = getKernel(gravType, element.state, intents);
+		if (kernel != nullptr) {
+			(this->*kernel)(batch, element);
+		}
+	}
+}
 
-	particle->velocity += getLocalGravity(particle->pos) * getProps(particle->type)->mass;
+// A particle swapped out of its chunk during an earlier phase has already moved this
+// tick. Running it from outside the chunk could carry it into reach of another chunk
+// in the same phase, so it waits until next tick.
+void Simulation::dropDisplaced(int chunk) {
+	olc::vi2d min = olc::vi2d(chunk % CHUNKS_X, chunk / CHUNKS_X) * CHUNK_SIZE;
+	olc::vi2d max = min + olc::vi2d(CHUNK_SIZE, CHUNK_SIZE);
+	const std::vector<olc::vi2d>& positions = this->world.positions;
+	for (std::vector<int32_t>& batch : this->batches[chunk]) {
+		std::erase_if(batch, [&positions, min, max](int32_t particle) {
+			olc::vi2d pos = positions[particle];
+			return pos.x < min.x || pos.y < min.y || pos.x >= max.x || pos.y >= max.y;
+		});
+	}
+}
 
-	particle->delta += particle->velocity;
-	olc::vf2d toMove = (olc::vi2d)particle->delta;
-	olc::vf2d norm = toMove.norm();
+void Simulation::moveByIntents(GravityType gravType) {
+	// Planning only reads the grid and writes each particle's own columns, plus an atomic
+	// claim on its target cell, so every chunk can plan at once without phases
+	if (this->jobs != nullptr) {
+		this->jobs->parallelFor((int)this->batches.size(), [this, gravType](int chunk) {
+			runBatches(this->batches[chunk], gravType, true);
+		});
+	} else {
+		runBatches(this->batches[0], gravType, true);
+	}
 
-	if (toMove.mag() > 0) {
-		particle->delta -= toMove;
+	// Moves go in batch order, each only if it still holds the claim on its cell and
+	// the cell can still be entered
+	for (const TypeBatches& chunkBatches : this->batches) {
+		for (int type = 0; type < Type::NONE; type++) {
+			const std::vector<int32_t>& batch = chunkBatches[type];
+			if (batch.empty()) continue;
+			switch (getElement((Type)type).state) {
+			case State::S_POWDER:
+				applyBatch<State::S_POWDER>(batch);
+				break;
+			case State::S_LIQUID:
+				applyBatch<State::S_LIQUID>(batch);
+				break;
+			case State::S_GAS:
+				applyBatch<State::S_GAS>(batch);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
 
-		olc::vi2d initial = particle->pos + toMove;
+void Simulation::updateSelfGravity(bool force) {
+	uint32_t interval = std::max(this->world.config.selfGravityInterval, 1u);
+	if (!force && this->world.tick % interval != 0) return;
+	this->selfGravity.solve(this->world, this->world.config.selfGravityStrength);
+}
 
-		if (tryPlace(particle, initial)) return;
+// Every awake particle the kernels ran this tick, moved or not, gives back the momentum its
+// drag took from the air, shared over the cells in an air cell so dense regions don't
+// swamp it
+void Simulation::pushAir() {
+	for (const TypeBatches& chunkBatches : this->batches) {
+		for (int type = 0; type < Type::NONE; type++) {
+			const Element& element = getElement((Type)type);
+			if (element.airDrag == 0 && element.airPressure == 0) continue;
+			float drag = element.airDrag / (AIR_CELL * AIR_CELL);
+			for (int32_t particle : chunkBatches[type]) {
+				if (this->world.types[particle] == Type::NONE) continue;
+				olc::vi2d pos = this->world.positions[particle];
+				olc::vf2d slip = fromVelocity(this->world.velocities[particle]) - this->world.air.sample(pos);
+				this->world.air.push(pos, slip * drag, element.airPressure);
+			}
+		}
+	}
+}
 
-		handleFriction(particle);
+template <GravityType G>
+Simulation::BatchKernel Simulation::getKernel(State state, bool intents) {
+	switch (state) {
+	case State::S_POWDER:
+		return intents ? &Simulation::planBatch<G, State::S_POWDER> : &Simulation::updateBatch<G, State::S_POWDER>;
+	case State::S_LIQUID:
+		return intents ? &Simulation::planBatch<G, State::S_LIQUID> : &Simulation::updateBatch<G, State::S_LIQUID>;
+	case State::S_GAS:
+		return intents ? &Simulation::planBatch<G, State::S_GAS> : &Simulation::updateBatch<G, State::S_GAS>;
+	default:
+		return nullptr;
+	}
+}
 
-		olc::vf2d dir = particle->velocity.norm().polar();
+Simulation::BatchKernel Simulation::getKernel(GravityType gravType, State state, bool intents) {
+	switch (gravType) {
+	case GravityType::VECTOR:
+		return getKernel<GravityType::VECTOR>(state, intents);
+	case GravityType::RADIAL:
+		return getKernel<GravityType::RADIAL>(state, intents);
+	case GravityType::FIELD:
+		return getKernel<GravityType::FIELD>(state, intents);
+	case GravityType::SELF:
+		return getKernel<GravityType::SELF>(state, intents);
+	case GravityType::OFF:
+	default:
+		return getKernel<GravityType::OFF>(state, intents);
+	}
+}
 
-		while (toMove.mag() >= 1) {
-			toMove -= norm;
+template <GravityType G>
+void Simulation::integrate(const std::vector<int32_t>& batch, const Element& element) {
+	std::vector<Velocity>& velocities = this->world.velocities;
+	std::vector<olc::vi2d>& deltas = this->world.deltas;
 
-			olc::vi2d nextPos = particle->pos + toMove;
+	// Air drags the velocity towards the wind in the particle's air cell. The wind is
+	// converted once and the drag applied in velocity arithmetic, so fixed-point
+	// velocities stay integer only.
+	if (this->world.config.air && element.airDrag != 0) {
+		const std::vector<olc::vi2d>& positions = this->world.positions;
+		for (int32_t particle : batch) {
+			Velocity wind = toVelocity(this->world.air.sample(positions[particle]));
+			velocities[particle] += scaleVelocity(wind - velocities[particle], element.airDragCoeff);
+		}
+	}
 
-			if (tryPlace(particle, nextPos)) return;
+	// Gravity and mass are fixed for the batch so these loops have no branches.
+	// Tombstoned particles are integrated too, harmlessly.
+	if constexpr (G == GravityType::VECTOR) {
+		Velocity step = toVelocity(this->world.config.gravVec * element.mass);
+		for (int32_t particle : batch) {
+			velocities[particle] += step;
+			deltas[particle] += velocityToSubcell(velocities[particle]);
+		}
+	} else if constexpr (G == GravityType::RADIAL || G == GravityType::FIELD || G == GravityType::SELF) {
+		for (int32_t particle : batch) {
+			velocities[particle] += toVelocity(getLocalGravity<G>(this->world.positions[particle]) * element.mass);
+			deltas[particle] += velocityToSubcell(velocities[particle]);
+		}
+	} else {
+		for (int32_t particle : batch) {
+			deltas[particle] += velocityToSubcell(velocities[particle]);
+		}
+	}
+}
 
-			olc::vf2d centre = olc::vf2d((float)nextPos.x + 0.5, (float)nextPos.y + 0.5);
-			
-			if (properties->reposeAngle < 90) {
-				for (int angle = 15; angle <= (90 - properties->reposeAngle); angle += 15) {
-					bool choice = random() < 0.5;
-					for (int i = 0; i < 2; i++) {
-						if (random() < 0.2) continue; // Makes it not so uniform, stops some weird behaviour
-						olc::vf2d sideDelta = olc::vf2d(1.42f, dir.y + toRads(choice ? angle : -angle));
-						olc::vi2d check = centre + sideDelta.cart();
-						if (tryPlace(particle, check)) {
-							return;
-						}
-						choice = !choice;
-					}
-				}
-			}
+template <GravityType G, State S>
+void Simulation::updateBatch(const std::vector<int32_t>& batch, const Element& element) {
+	integrate<G>(batch, element);
+	for (int32_t particle : batch) {
+		if (this->world.types[particle] == Type::NONE) continue;
+		olc::vi2d start = this->world.positions[particle];
+		moveParticle<S>(particle, element);
+		if constexpr (S == State::S_GAS) {
+			disperse<S>(particle, element);
+		}
+		// Moving already marked the cell, otherwise stay visited until asleep
+		if (this->world.positions[particle] == start && !this->world.isAsleep(particle)) {
+			this->world.markDirty(start, start);
 		}
-		// It's just not able to move
-		particle->velocity *= 0;
-		particle->delta *= 0;
 	}
 }
 
-void Simulation::updatePowder(ParticleState* particle) {
-	return updatePhysicsParticle(particle);
+template <GravityType G, State S>
+void Simulation::planBatch(const std::vector<int32_t>& batch, const Element& element) {
+	integrate<G>(batch, element);
+	for (int32_t particle : batch) {
+		olc::vi2d pos = this->world.positions[particle];
+		olc::vi2d target = planMove<S>(particle, element);
+		if constexpr (S == State::S_GAS) {
+			if (target == pos) target = planDisperse<S>(particle, element);
+		}
+		this->intents[particle] = target;
+		if (target == pos) continue;
+
+		std::atomic_ref<uint64_t> claim(this->claims[target.y * PIX_X + target.x]);
+		uint64_t priority = intentPriority(this->world, particle);
+		uint64_t current = claim.load(std::memory_order_relaxed);
+		while (priority < current && !claim.compare_exchange_weak(current, priority, std::memory_order_relaxed)) {
+		}
+	}
+}
+
+template <State S>
+void Simulation::applyBatch(const std::vector<int32_t>& batch) {
+	for (int32_t particle : batch) {
+		olc::vi2d start = this->world.positions[particle];
+		olc::vi2d target = this->intents[particle];
+		if (target != start) {
+			// Only the winner resets the claim, so later losers still see they lost
+			uint64_t& claim = this->claims[target.y * PIX_X + target.x];
+			if (claim == intentPriority(this->world, particle)) {
+				claim = NO_CLAIM;
+				tryPlace<S>(particle, target);
+			}
+		}
+		if (this->world.positions[particle] == start && !this->world.isAsleep(particle)) {
+			this->world.markDirty(start, start);
+		}
+	}
 }
 
-void Simulation::updateLiquid(ParticleState* particle) {
-	return updatePhysicsParticle(particle);
+template <State S>
+bool Simulation::canEnter(olc::vi2d pos) {
+	if (!inBounds(pos)) return false;
+	int32_t occupant = this->world.grid[pos.y][pos.x];
+	return occupant == NO_PARTICLE || S < getElement(this->world.types[occupant]).state;
 }
 
-void Simulation::updateGas(ParticleState* particle) {
-	updatePhysicsParticle(particle);
+// The same walk and repose search as moveParticle, run against the unchanged grid and
+// returning where the particle wants to end up. A particle blocked part way along
+// slides off from the last cell it reached.
+template <State S>
+olc::vi2d Simulation::planMove(int32_t particle, const Element& element) {
+	olc::vi2d pos = this->world.positions[particle];
+	Velocity& velocity = this->world.velocities[particle];
+	olc::vi2d& delta = this->world.deltas[particle];
 
-	if (random() < getProps(particle->type)->dispersion) {
+	olc::vi2d toMove = delta / SUBCELL_ONE;
+	if (toMove.x == 0 && toMove.y == 0) {
+		if (velocity == Velocity()) {
+			uint8_t& blocked = this->world.blocked[particle];
+			if (blocked < SLEEP_ATTEMPTS) blocked++;
+		}
+		return pos;
+	}
+	delta -= toMove * SUBCELL_ONE;
+	toMove.x = std::clamp(toMove.x, -this->maxStep, this->maxStep);
+	toMove.y = std::clamp(toMove.y, -this->maxStep, this->maxStep);
+
+	olc::vi2d step = olc::vi2d(toMove.x > 0 ? 1 : -1, toMove.y > 0 ? 1 : -1);
+	int major = std::max(std::abs(toMove.x), std::abs(toMove.y));
+	int minor = std::min(std::abs(toMove.x), std::abs(toMove.y));
+	bool xMajor = std::abs(toMove.x) >= std::abs(toMove.y);
+	int error = 2 * minor - major;
+	olc::vi2d reached = pos;
+	for (int i = 0; i < major; i++) {
+		olc::vi2d next = reached;
+		if (xMajor) next.x += step.x;
+		else next.y += step.y;
+		if (error > 0) {
+			if (xMajor) next.y += step.y;
+			else next.x += step.x;
+			error -= 2 * major;
+		}
+		error += 2 * minor;
+
+		if (canEnter<S>(next)) {
+			reached = next;
+			continue;
+		}
+
+		velocity = scaleVelocity(velocity, element.frictionCoeff);
+
+		olc::vf2d heading = fromVelocity(velocity);
+		int dir = quantiseDirection(heading.mag2() > 0 ? heading : olc::vf2d(toMove));
+		int reposeSteps = (90 - element.reposeAngle) / 15;
+		Random rng = Random(this->world.seed, this->world.tick, particle, RNG_REPOSE);
+		for (int repose = 1; repose <= reposeSteps; repose++) {
+			bool choice = rng.nextFloat() < 0.5f;
+			for (int j = 0; j < 2; j++) {
+				if (rng.nextFloat() < 0.2f) continue;
+				int side = (choice ? repose : -repose) * DIR_PER_REPOSE_STEP;
+				olc::vi2d check = reached + reposeTable.offsets[(dir + side + DIR_STEPS) % DIR_STEPS];
+				if (canEnter<S>(check)) {
+					return check;
+				}
+				choice = !choice;
+			}
+		}
+		if (i == 0) {
+			velocity = Velocity();
+			delta *= 0;
+			uint8_t& blocked = this->world.blocked[particle];
+			if (blocked < SLEEP_ATTEMPTS) blocked++;
+		}
+		return reached;
+	}
+	return reached;
+}
+
+template <State S>
+olc::vi2d Simulation::planDisperse(int32_t particle, const Element& element) {
+	olc::vi2d pos = this->world.positions[particle];
+	Random rng = Random(this->world.seed, this->world.tick, particle, RNG_DISPERSE);
+	if (rng.nextFloat() < element.dispersion) {
 		olc::vi2d valid[8];
 		int numValid = 0;
 		for (int dy = -1; dy <= 1; dy++) {
 			for (int dx = -1; dx <= 1; dx++) {
 				if (dx == 0 && dy == 0) continue;
-				olc::vi2d checkPos = particle->pos + olc::vi2d(dx, dy);
-				if (inBounds(checkPos)) {
-					ParticleState* state = partGrid[checkPos.y][checkPos.x];
-					if (state == nullptr) {
-						valid[numValid++] = checkPos;
-					}
+				olc::vi2d checkPos = pos + olc::vi2d(dx, dy);
+				if (inBounds(checkPos) && this->world.grid[checkPos.y][checkPos.x] == NO_PARTICLE) {
+					valid[numValid++] = checkPos;
 				}
 			}
 		}
 		if (numValid > 0) {
-			olc::vi2d chosen = valid[rand() % numValid];
-			tryPlace(particle, chosen);
+			return valid[rng.nextInt(numValid)];
 		}
 	}
+	return pos;
 }
 
-olc::vf2d Simulation::getLocalGravity(olc::vi2d pos) {
-	switch (CONFIG.gravType) {
-	case GravityType::VECTOR:
-		return CONFIG.gravVec;
-		break;
-	case GravityType::RADIAL:
-	{
-		olc::vf2d toCentre = olc::vi2d(WIDTH / 2, HEIGHT / 2) - pos;
-		if (toCentre.mag() == 0) return olc::vf2d(0, 0);
-		else return toCentre.norm() * std::min(0.05f, 20 / toCentre.mag());
-		break;
-	}
-	case GravityType::OFF:
-	default:
-		return olc::vf2d(0, 0);
+template <State S>
+bool Simulation::tryPlace(int32_t particle, olc::vi2d newPos) {
+	olc::vi2d& pos = this->world.positions[particle];
+	if (pos == newPos) return false;
+
+	if (inBounds(newPos)) {
+		int32_t newParticle = this->world.grid[newPos.y][newPos.x];
+		if (newParticle == NO_PARTICLE) {
+			this->world.grid[newPos.y][newPos.x] = particle;
+			this->world.grid[pos.y][pos.x] = NO_PARTICLE;
+			this->world.wake(pos, newPos);
+			pos = newPos;
+			return true;
+		}
+		if (S < getElement(this->world.types[newParticle]).state) {
+			this->world.grid[newPos.y][newPos.x] = particle;
+			this->world.grid[pos.y][pos.x] = newParticle;
+			this->world.positions[newParticle] = pos;
+			this->world.wake(pos, newPos);
+			pos = newPos;
+			return true;
+		}
 	}
+	return false;
 }
 
-void Simulation::remove(ParticleState* state) {
-	olc::vi2d pos = state->pos;
-	partGrid[pos.y][pos.x] = nullptr;
-	for (int i = 0; i < partArr.size(); i++) {
-		if (state == partArr[i]) {
-			partArr.erase(partArr.begin() + i);
-			break;
+template <State S>
+void Simulation::moveParticle(int32_t particle, const Element& element) {
+	olc::vi2d& pos = this->world.positions[particle];
+	Velocity& velocity = this->world.velocities[particle];
+	olc::vi2d& delta = this->world.deltas[particle];
+
+	// Whole cells to move this tick, truncated towards zero like the sub-cell offset
+	olc::vi2d toMove = delta / SUBCELL_ONE;
+	if (toMove.x == 0 && toMove.y == 0) {
+		// Nothing is pushing it, so it sleeps like a blocked particle would
+		if (velocity == Velocity()) {
+			uint8_t& blocked = this->world.blocked[particle];
+			if (blocked < SLEEP_ATTEMPTS) blocked++;
+		}
+		return;
+	}
+	delta -= toMove * SUBCELL_ONE;
+	toMove.x = std::clamp(toMove.x, -this->maxStep, this->maxStep);
+	toMove.y = std::clamp(toMove.y, -this->maxStep, this->maxStep);
+
+	// Walk the line to the destination one cell at a time (Bresenham), stopping at the
+	// first cell we can't enter
+	olc::vi2d step = olc::vi2d(toMove.x > 0 ? 1 : -1, toMove.y > 0 ? 1 : -1);
+	int major = std::max(std::abs(toMove.x), std::abs(toMove.y));
+	int minor = std::min(std::abs(toMove.x), std::abs(toMove.y));
+	bool xMajor = std::abs(toMove.x) >= std::abs(toMove.y);
+	int error = 2 * minor - major;
+	for (int i = 0; i < major; i++) {
+		olc::vi2d next = pos;
+		if (xMajor) next.x += step.x;
+		else next.y += step.y;
+		if (error > 0) {
+			if (xMajor) next.y += step.y;
+			else next.x += step.x;
+			error -= 2 * major;
+		}
+		error += 2 * minor;
+
+		if (tryPlace<S>(particle, next)) continue;
+
+		velocity = scaleVelocity(velocity, element.frictionCoeff);
+
+		// Blocked, try to slide off to either side of the direction of travel
+		olc::vf2d heading = fromVelocity(velocity);
+		int dir = quantiseDirection(heading.mag2() > 0 ? heading : olc::vf2d(toMove));
+		int reposeSteps = (90 - element.reposeAngle) / 15;
+		Random rng = Random(this->world.seed, this->world.tick, particle, RNG_REPOSE);
+		for (int repose = 1; repose <= reposeSteps; repose++) {
+			bool choice = rng.nextFloat() < 0.5f;
+			for (int j = 0; j < 2; j++) {
+				if (rng.nextFloat() < 0.2f) continue; // Makes it not so uniform, stops some weird behaviour
+				int side = (choice ? repose : -repose) * DIR_PER_REPOSE_STEP;
+				olc::vi2d check = pos + reposeTable.offsets[(dir + side + DIR_STEPS) % DIR_STEPS];
+				if (tryPlace<S>(particle, check)) {
+					return;
+				}
+				choice = !choice;
+			}
+		}
+		if (i == 0) {
+			// It's just not able to move
+			velocity = Velocity();
+			delta *= 0;
+			uint8_t& blocked = this->world.blocked[particle];
+			if (blocked < SLEEP_ATTEMPTS) blocked++;
 		}
+		return;
 	}
-	state->dead = true;
-	for (int i = (int) partArr.size() - 1; i >= 0; i--) {
-		if (partArr[i]->pos == pos) {
-			partGrid[pos.y][pos.x] = partArr[i];
-			break;
+}
+
+template <State S>
+void Simulation::disperse(int32_t particle, const Element& element) {
+	Random rng = Random(this->world.seed, this->world.tick, particle, RNG_DISPERSE);
+	if (rng.nextFloat() < element.dispersion) {
+		olc::vi2d valid[8];
+		int numValid = 0;
+		for (int dy = -1; dy <= 1; dy++) {
+			for (int dx = -1; dx <= 1; dx++) {
+				if (dx == 0 && dy == 0) continue;
+				olc::vi2d checkPos = this->world.positions[particle] + olc::vi2d(dx, dy);
+				if (inBounds(checkPos)) {
+					if (this->world.grid[checkPos.y][checkPos.x] == NO_PARTICLE) {
+						valid[numValid++] = checkPos;
+					}
+				}
+			}
+		}
+		if (numValid > 0) {
+			olc::vi2d chosen = valid[rng.nextInt(numValid)];
+			tryPlace<S>(particle, chosen);
 		}
 	}
-	state->dead = true;
 }
 
-ParticleState* Simulation::add(olc::vi2d pos, Type type) {
-	static int idx = 0;
-	if (partArr.size() == MAX_PARTS) {
-		return nullptr;
+template <GravityType G>
+olc::vf2d Simulation::getLocalGravity(olc::vi2d pos) {
+	if constexpr (G == GravityType::VECTOR) {
+		return this->world.config.gravVec;
+	} else if constexpr (G == GravityType::RADIAL) {
+		return this->world.radialField.sample(pos);
+	} else if constexpr (G == GravityType::FIELD) {
+		return this->world.gravityField.sample(pos);
+	} else if constexpr (G == GravityType::SELF) {
+		return this->selfGravity.sample(pos);
+	} else {
+		return olc::vf2d(0, 0);
 	}
-	for (int i = 0; i < MAX_PARTS; i++) {
-		if (this->particlePool[idx].dead) {
-			ParticleState* state = &this->particlePool[idx];
-			*state = {
-				.type = type,
-				.pos = pos,
-				.velocity = olc::vf2d(),
-				.delta = olc::vf2d(),
-				.deco = olc::Pixel(0, 0, 0, 0),
-				.dead = false
-			};
-			std::memset(state->data, 0, 10);
-			getProps(type)->init(state);
-			partArr.push_back(state);
-			partGrid[pos.y][pos.x] = state;
-			return state;
-		}
-		idx = (idx + 1) % MAX_PARTS;
-	}
-	return nullptr;
 }
\ No newline at end of file
@@ -1,29 +1,104 @@
 #pragma once
 
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "jobs.h"
 #include "sandbox.h"
+#include "particles.h"
+#include "world.h"
+
+typedef struct {
+	int particles;
+	int visited;
+	int sleeping;
+	int removed;
+	uint64_t tickNs;
+	uint64_t compactNs;
+	uint64_t reorderNs;
+	uint64_t airNs;
+	uint64_t heatNs;
+} TickStats;
 
 class Simulation {
 public:
-	Simulation() {
-		this->particlePool = new ParticleState[MAX_PARTS * 5];
-		for (int i = 0; i < MAX_PARTS; i++) {
-			this->particlePool[i].dead = true;
-		}
-	}
+	// Timings and counts for the most recent tick
+	TickStats stats = {};
+
+	// With more than one thread, or in deterministic mode, the tick runs chunk by chunk
+	// in a four phase checkerboard and the result is the same for any thread count.
+	// Otherwise it runs serially over the whole world.
+	Simulation(World& world, int threads = 1, bool deterministic = false);
 
 	void tick();
-	void remove(ParticleState* state);
-	ParticleState* add(olc::vi2d pos, Type type);
+	void setThreads(int threads, bool deterministic = false);
+	int getThreads() const;
+	bool isChunked() const;
+	// Worker pool of a parallel tick, or nullptr when the tick runs serially
+	JobSystem* getJobs();
 
 private:
-	ParticleState* particlePool;
+	World& world;
 
-	void updatePhysicsParticle(ParticleState* particle);
-	void updatePowder(ParticleState* particle);
-	void updateLiquid(ParticleState* particle);
-	void updateGas(ParticleState* particle);
-	olc::vf2d getLocalGravity(olc::vi2d pos);
-	bool tryPlace(ParticleState* particle, olc::vi2d newPos);
-};
+	typedef std::array<std::vector<int32_t>, Type::NONE> TypeBatches;
+	// Awake particles for the physics kernels, one set per chunk in a parallel tick and
+	// a single set otherwise, and every visited particle for the update hooks
+	std::vector<TypeBatches> batches;
+	TypeBatches hookBatches;
+	// Chunks with work in each checkerboard phase
+	std::array<std::vector<int>, 4> phases;
+	std::unique_ptr<JobSystem> jobs;
+	// Furthest a particle may move along each axis in one tick
+	int maxStep;
+	// One bit per particle id, set for the particles in this tick's dirty regions
+	std::vector<uint64_t> visiting;
+	// Planned destination of each particle and the winning claim on each cell, for the
+	// INTENTS move model
+	std::vector<olc::vi2d> intents;
+	std::vector<uint64_t> claims;
+	// Set once a tick visits anything, so renumbering can be skipped while the world is
+	// at rest
+	bool changedSinceReorder = true;
+	// Gravity the sleeping particles settled under, a change wakes everything
+	GravityType lastGravType;
+	olc::vf2d lastGravVec;
+	uint32_t lastFieldVersion;
+	SelfGravity selfGravity;
 
-std::shared_ptr<Simulation> getSimulation();
\ No newline at end of file
+	// One kernel per gravity mode and material state, picked once per batch
+	typedef void (Simulation::*BatchKernel)(const std::vector<int32_t>& batch, const Element& element);
+
+	template <GravityType G>
+	static BatchKernel getKernel(State state, bool intents);
+	static BatchKernel getKernel(GravityType gravType, State state, bool intents);
+
+	void runBatches(const TypeBatches& batches, GravityType gravType, bool intents);
+	void dropDisplaced(int chunk);
+	void moveByIntents(GravityType gravType);
+	void updateSelfGravity(bool force);
+	void pushAir();
+
+	template <GravityType G>
+	void integrate(const std::vector<int32_t>& batch, const Element& element);
+	template <GravityType G, State S>
+	void updateBatch(const std::vector<int32_t>& batch, const Element& element);
+	template <GravityType G, State S>
+	void planBatch(const std::vector<int32_t>& batch, const Element& element);
+	template <State S>
+	void applyBatch(const std::vector<int32_t>& batch);
+	template <State S>
+	olc::vi2d planMove(int32_t particle, const Element& element);
+	template <State S>
+	olc::vi2d planDisperse(int32_t particle, const Element& element);
+	template <State S>
+	bool canEnter(olc::vi2d pos);
+	template <State S>
+	void moveParticle(int32_t particle, const Element& element);
+	template <State S>
+	void disperse(int32_t particle, const Element& element);
+	template <GravityType G>
+	olc::vf2d getLocalGravity(olc::vi2d pos);
+	template <State S>
+	bool tryPlace(int32_t particle, olc::vi2d newPos);
+};
\ No newline at end of file
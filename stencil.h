@@ -0,0 +1,36 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+
+#include "jobs.h"
+
+// The air and heat grids are row-major arrays with a border one cell wide around them,
+// so a stencil runs straight along a row with no bounds checks. Each row is a plain loop
+// over __restrict pointers, with the rows above and below a stride away and never
+// overlapping the output, which the compiler vectorises.
+
+static constexpr int paddedSize(int width, int height) {
+	return (width + 2) * (height + 2);
+}
+
+static inline int paddedIndex(int x, int y, int width) {
+	return (y + 1) * (width + 2) + x + 1;
+}
+
+// Runs rows(band, y0, y1) over bands of bandRows rows covering [0, height), split over
+// the jobs when given and in order on this thread otherwise. Bands must not write to
+// each other's rows.
+static inline void runBands(JobSystem* jobs, int height, int bandRows, const std::function<void(int, int, int)>& rows) {
+	int bands = (height + bandRows - 1) / bandRows;
+	auto run = [height, bandRows, &rows](int band) {
+		rows(band, band * bandRows, std::min((band + 1) * bandRows, height));
+	};
+	if (jobs != nullptr) {
+		jobs->parallelFor(bands, run);
+	} else {
+		for (int band = 0; band < bands; band++) {
+			run(band);
+		}
+	}
+}
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <random>
+#include <type_traits>
+
+#include "sandbox.h"
+#include "particles.h"
+#include "world.h"
+
+// Ids are renumbered once runs of consecutive ids in grid order get shorter than this
+// on average
+static constexpr int REORDER_RUN_LENGTH = 16;
+
+World::World() : World(((uint64_t)std::random_device()() << 32) | std::random_device()()) {
+}
+
+World::World(uint64_t seed) :
+	seed(seed),
+	types(MAX_PARTS, Type::NONE),
+	positions(MAX_PARTS),
+	velocities(MAX_PARTS),
+	deltas(MAX_PARTS),
+	data(MAX_PARTS),
+	decos(MAX_PARTS),
+	partIndex(MAX_PARTS),
+	blocked(MAX_PARTS),
+	neighboursChanged(MAX_PARTS),
+	freeIds(MAX_PARTS) {
+	this->reorderIds.reserve(MAX_PARTS);
+	this->config = {
+		.gravType = VECTOR,
+		.gravVec = olc::vf2d(0, 0.05f),
+		.ticking = true,
+		.moveModel = MoveModel::SEQUENTIAL,
+		.reorderInterval = 64,
+		.selfGravityInterval = 4,
+		.selfGravityStrength = 0.03f,
+		.air = false,
+		.heat = false
+	};
+	this->radialField.addSource(makeAttractor(olc::vf2d(PIX_X / 2, PIX_Y / 2), 0.05f, 20));
+	this->parts.reserve(MAX_PARTS);
+	this->grid = new int32_t[PIX_Y][PIX_X];
+	for (int y = 0; y < PIX_Y; y++) {
+		for (int x = 0; x < PIX_X; x++) {
+			this->grid[y][x] = NO_PARTICLE;
+		}
+	}
+	resetFreeIds();
+	this->dirty.fill(NO_DIRTY);
+	this->active.fill(NO_DIRTY);
+	this->renderDirty.fill(NO_DIRTY);
+	markAllDirty();
+}
+
+World::~World() {
+	delete[] this->grid;
+}
+
+void World::resetFreeIds() {
+	for (int i = 0; i < MAX_PARTS; i++) {
+		this->freeIds[i] = i;
+	}
+	this->freeHead = 0;
+	this->freeCount = MAX_PARTS;
+}
+
+void World::releaseId(int32_t id) {
+	this->freeIds[(this->freeHead + this->freeCount) % MAX_PARTS] = id;
+	this->freeCount++;
+}
+
+void World::remove(int32_t id) {
+	olc::vi2d pos = this->positions[id];
+	this->grid[pos.y][pos.x] = NO_PARTICLE;
+	this->types[id] = Type::NONE;
+	wake(pos);
+
+	if (this->deferRemovals) {
+		this->pendingRemovals++;
+		return;
+	}
+
+	int32_t index = this->partIndex[id];
+	int32_t last = this->parts.back();
+	this->parts[index] = last;
+	this->partIndex[last] = index;
+	this->parts.pop_back();
+	releaseId(id);
+}
+
+void World::transmute(int32_t id, Type type) {
+	this->types[id] = type;
+	this->decos[id] = olc::Pixel(0, 0, 0, 0);
+	this->data[id].fill(0);
+	wake(this->positions[id]);
+	getProps(type).init(*this, id);
+}
+
+int World::compact() {
+	int removed = this->pendingRemovals;
+	if (removed == 0) return 0;
+	int32_t kept = 0;
+	for (int32_t id : this->parts) {
+		if (this->types[id] == Type::NONE) {
+			releaseId(id);
+		} else {
+			this->partIndex[id] = kept;
+			this->parts[kept++] = id;
+		}
+	}
+	this->parts.resize(kept);
+	this->pendingRemovals = 0;
+	return removed;
+}
+
+int32_t World::add(olc::vi2d pos, Type type) {
+	if (this->freeCount == 0 || this->grid[pos.y][pos.x] != NO_PARTICLE) {
+		return NO_PARTICLE;
+	}
+	int32_t id = this->freeIds[this->freeHead];
+	this->freeHead = (this->freeHead + 1) % MAX_PARTS;
+	this->freeCount--;
+
+	this->types[id] = type;
+	this->positions[id] = pos;
+	this->velocities[id] = Velocity();
+	this->deltas[id] = olc::vi2d();
+	this->decos[id] = olc::Pixel(0, 0, 0, 0);
+	this->data[id].fill(0);
+	this->blocked[id] = 0;
+	this->partIndex[id] = (int32_t)this->parts.size();
+	this->parts.push_back(id);
+	this->grid[pos.y][pos.x] = id;
+	wake(pos);
+	getProps(type).init(*this, id);
+	return id;
+}
+
+void World::clear() {
+	for (int32_t id : this->parts) {
+		olc::vi2d pos = this->positions[id];
+		this->grid[pos.y][pos.x] = NO_PARTICLE;
+		this->types[id] = Type::NONE;
+	}
+	this->parts.clear();
+	this->pendingRemovals = 0;
+	resetFreeIds();
+	this->air.clear();
+	this->heat.clear();
+	markAllDirty();
+}
+
+// Reorders one column so the particle that had id order[i] now has id i, gathering into
+// scratch memory shared by all the columns
+template <typename T>
+static void permute(std::vector<T>& column, const std::vector<int32_t>& order, std::vector<uint8_t>& scratch) {
+	static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= sizeof(PartData));
+	T* sorted = reinterpret_cast<T*>(scratch.data());
+	for (size_t i = 0; i < order.size(); i++) {
+		sorted[i] = column[order[i]];
+	}
+	std::copy(sorted, sorted + order.size(), column.begin());
+}
+
+bool World::reorder() {
+	// Sweep the rows bottom up, snaking so neighbouring rows meet at the same end
+	std::vector<int32_t>& order = this->reorderIds;
+	order.clear();
+	for (int y = PIX_Y - 1; y >= 0; y--) {
+		bool reverse = y % 2 == 1;
+		for (int i = 0; i < PIX_X; i++) {
+			int32_t id = this->grid[y][reverse ? PIX_X - 1 - i : i];
+			if (id != NO_PARTICLE) order.push_back(id);
+		}
+	}
+
+	// Leave the ids alone while runs of consecutive ids still make up most of the sweep
+	int32_t count = (int32_t)order.size();
+	int breaks = 0;
+	for (int32_t i = 1; i < count; i++) {
+		breaks += order[i] != order[i - 1] + 1;
+	}
+	if (breaks * REORDER_RUN_LENGTH <= count) return false;
+
+	this->reorderScratch.resize(MAX_PARTS * sizeof(PartData));
+	permute(this->types, order, this->reorderScratch);
+	permute(this->positions, order, this->reorderScratch);
+	permute(this->velocities, order, this->reorderScratch);
+	permute(this->deltas, order, this->reorderScratch);
+	permute(this->data, order, this->reorderScratch);
+	permute(this->decos, order, this->reorderScratch);
+	permute(this->blocked, order, this->reorderScratch);
+	permute(this->neighboursChanged, order, this->reorderScratch);
+
+	std::fill(this->types.begin() + count, this->types.end(), Type::NONE);
+	this->parts.resize(count);
+	for (int32_t id = 0; id < count; id++) {
+		this->parts[id] = id;
+		this->partIndex[id] = id;
+		olc::vi2d pos = this->positions[id];
+		this->grid[pos.y][pos.x] = id;
+	}
+	for (int i = 0; i < MAX_PARTS - count; i++) {
+		this->freeIds[i] = count + i;
+	}
+	this->freeHead = 0;
+	this->freeCount = MAX_PARTS - count;
+	return true;
+}
+
+void World::wakeAll() {
+	for (int32_t id : this->parts) {
+		this->blocked[id] = 0;
+	}
+	markAllDirty();
+}
+
+void World::wakeArea(olc::vi2d min, olc::vi2d max) {
+	for (int y = std::max(min.y, 0); y <= std::min(max.y, PIX_Y - 1); y++) {
+		for (int x = std::max(min.x, 0); x <= std::min(max.x, PIX_X - 1); x++) {
+			int32_t id = this->grid[y][x];
+			if (id != NO_PARTICLE) this->blocked[id] = 0;
+		}
+	}
+	markDirty(min, max);
+}
+
+void World::markAllDirty() {
+	markDirty(olc::vi2d(0, 0), olc::vi2d(PIX_X - 1, PIX_Y - 1));
+}
+
+void World::swapDirty() {
+	for (int chunk = 0; chunk < CHUNK_COUNT; chunk++) {
+		this->renderDirty[chunk] = merge(this->renderDirty[chunk], this->dirty[chunk]);
+	}
+	this->active = this->dirty;
+	this->dirty.fill(NO_DIRTY);
+}
+
+uint64_t World::checksum() const {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	auto add = [&hash](const void* bytes, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ ((const uint8_t*)bytes)[i]) * 0x100000001b3ULL;
+		}
+	};
+	add(&this->tick, sizeof(this->tick));
+	for (int y = 0; y < PIX_Y; y++) {
+		for (int x = 0; x < PIX_X; x++) {
+			int32_t id = this->grid[y][x];
+			if (id == NO_PARTICLE) continue;
+			int32_t cell = y * PIX_X + x;
+			add(&cell, sizeof(cell));
+			add(&id, sizeof(id));
+			add(&this->types[id], sizeof(Type));
+			add(&this->velocities[id], sizeof(Velocity));
+			add(&this->deltas[id], sizeof(olc::vi2d));
+			add(this->data[id].data(), sizeof(PartData));
+		}
+	}
+	if (this->config.air) {
+		uint64_t air = this->air.checksum();
+		add(&air, sizeof(air));
+	}
+	if (this->config.heat) {
+		for (int y = 0; y < PIX_Y; y++) {
+			for (int x = 0; x < PIX_X; x++) {
+				float temp = this->heat.get(olc::vi2d(x, y));
+				add(&temp, sizeof(temp));
+			}
+		}
+	}
+	return mixBits(hash);
+}
\ No newline at end of file
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include "air.h"
+#include "gravity.h"
+#include "heat.h"
+#include "rng.h"
+#include "sandbox.h"
+
+// Inclusive bounds of the cells changed within one chunk, empty while minX > maxX
+typedef struct {
+	int16_t minX;
+	int16_t minY;
+	int16_t maxX;
+	int16_t maxY;
+} DirtyRect;
+
+static constexpr DirtyRect NO_DIRTY = { PIX_X, PIX_Y, -1, -1 };
+
+static inline bool isEmpty(const DirtyRect& rect) {
+	return rect.minX > rect.maxX;
+}
+
+// Chunks around a parallel tick's chunks can be marked from two threads at once
+static inline void atomicMin(int16_t& value, int16_t x) {
+	std::atomic_ref<int16_t> ref(value);
+	int16_t current = ref.load(std::memory_order_relaxed);
+	while (x < current && !ref.compare_exchange_weak(current, x, std::memory_order_relaxed)) {
+	}
+}
+
+static inline void atomicMax(int16_t& value, int16_t x) {
+	std::atomic_ref<int16_t> ref(value);
+	int16_t current = ref.load(std::memory_order_relaxed);
+	while (x > current && !ref.compare_exchange_weak(current, x, std::memory_order_relaxed)) {
+	}
+}
+
+static inline void expand(DirtyRect& rect, int16_t x0, int16_t y0, int16_t x1, int16_t y1) {
+	atomicMin(rect.minX, x0);
+	atomicMin(rect.minY, y0);
+	atomicMax(rect.maxX, x1);
+	atomicMax(rect.maxY, y1);
+}
+
+static inline DirtyRect merge(const DirtyRect& a, const DirtyRect& b) {
+	DirtyRect rect = a;
+	expand(rect, b.minX, b.minY, b.maxX, b.maxY);
+	return rect;
+}
+
+class World {
+public:
+	Config config;
+	// Seed for the counter-based Random streams, and the number of ticks run so far
+	uint64_t seed;
+	uint32_t tick = 0;
+
+	// Particle pool, stored as one column per field and indexed by particle id.
+	// Free slots have type NONE.
+	std::vector<Type> types;
+	std::vector<olc::vi2d> positions;
+	std::vector<Velocity> velocities;
+	std::vector<olc::vi2d> deltas;
+	std::vector<PartData> data;
+	std::vector<olc::Pixel> decos;
+	// Position of each live particle in parts
+	std::vector<int32_t> partIndex;
+	// Move attempts blocked in a row, the particle sleeps once this reaches SLEEP_ATTEMPTS
+	std::vector<uint8_t> blocked;
+	// Set whenever a cell in the 3x3 around the particle changes. Fire clears it once it
+	// has checked its neighbours, so only fire next to something new looks again.
+	std::vector<uint8_t> neighboursChanged;
+
+	std::vector<int32_t> parts;
+	area_t grid;
+
+	// Cells changed since the last tick started, and the ones the current tick visits.
+	// renderDirty gathers each tick's changes until the renderer next draws.
+	std::array<DirtyRect, CHUNK_COUNT> dirty;
+	std::array<DirtyRect, CHUNK_COUNT> active;
+	std::array<DirtyRect, CHUNK_COUNT> renderDirty;
+
+	// While set, remove() only tombstones particles and compact() reclaims them
+	bool deferRemovals = false;
+
+	// Sampled by RADIAL and FIELD gravity respectively
+	GravityField radialField;
+	GravityField gravityField;
+	Air air;
+	Heat heat;
+
+	World();
+	// Worlds with the same seed, fed the same particles and ticks, stay identical
+	World(uint64_t seed);
+	~World();
+	World(const World&) = delete;
+	World& operator=(const World&) = delete;
+
+	int32_t add(olc::vi2d pos, Type type);
+	void remove(int32_t id);
+	// Turn a particle into another element in place, keeping its id, position and
+	// velocity and running the new element's init
+	void transmute(int32_t id, Type type);
+	void clear();
+	int compact();
+	// Renumber the live particles in grid order so walking ids walks the grid, unless
+	// they are still mostly in that order. Only call between ticks, ids held from before
+	// are invalid afterwards if it returns true.
+	bool reorder();
+	// Hash of the tick and every particle's state, equal for two worlds that will
+	// simulate the same from here on
+	uint64_t checksum() const;
+	void wakeAll();
+	// Wake every particle in the inclusive cell range
+	void wakeArea(olc::vi2d min, olc::vi2d max);
+	void markAllDirty();
+	// Start a tick, the cells dirtied so far become the ones it visits
+	void swapDirty();
+
+	// Expand the dirty rectangles of every chunk the inclusive cell range overlaps
+	inline void markDirty(olc::vi2d min, olc::vi2d max) {
+		min = olc::vi2d(std::max(min.x, 0), std::max(min.y, 0));
+		max = olc::vi2d(std::min(max.x, PIX_X - 1), std::min(max.y, PIX_Y - 1));
+		int cx0 = (unsigned)min.x / CHUNK_SIZE;
+		int cy0 = (unsigned)min.y / CHUNK_SIZE;
+		int cx1 = (unsigned)max.x / CHUNK_SIZE;
+		int cy1 = (unsigned)max.y / CHUNK_SIZE;
+		if (cx0 == cx1 && cy0 == cy1) {
+			expand(this->dirty[cy0 * CHUNKS_X + cx0], (int16_t)min.x, (int16_t)min.y, (int16_t)max.x, (int16_t)max.y);
+			return;
+		}
+		for (int cy = cy0; cy <= cy1; cy++) {
+			for (int cx = cx0; cx <= cx1; cx++) {
+				int16_t x0 = (int16_t)std::max(min.x, cx * CHUNK_SIZE);
+				int16_t y0 = (int16_t)std::max(min.y, cy * CHUNK_SIZE);
+				int16_t x1 = (int16_t)std::min(max.x, cx * CHUNK_SIZE + CHUNK_SIZE - 1);
+				int16_t y1 = (int16_t)std::min(max.y, cy * CHUNK_SIZE + CHUNK_SIZE - 1);
+				expand(this->dirty[cy * CHUNKS_X + cx], x0, y0, x1, y1);
+			}
+		}
+	}
+
+	// Wake the particles around a cell whose contents changed, and visit them next tick
+	inline void wake(olc::vi2d pos) {
+		wakeNeighbours(pos);
+		markDirty(pos - olc::vi2d(1, 1), pos + olc::vi2d(1, 1));
+	}
+
+	// Same for a particle that moved between two adjacent cells
+	inline void wake(olc::vi2d from, olc::vi2d to) {
+		wakeNeighbours(from);
+		wakeNeighbours(to);
+		markDirty(olc::vi2d(std::min(from.x, to.x), std::min(from.y, to.y)) - olc::vi2d(1, 1),
+			olc::vi2d(std::max(from.x, to.x), std::max(from.y, to.y)) + olc::vi2d(1, 1));
+	}
+
+	inline bool isAsleep(int32_t id) const {
+		return this->blocked[id] >= SLEEP_ATTEMPTS;
+	}
+
+private:
+	// Free pool slots, handed out oldest first so a freed id is not reused straight away
+	std::vector<int32_t> freeIds;
+	int freeHead = 0;
+	int freeCount = 0;
+
+	int pendingRemovals = 0;
+
+	// Grid order of the particles and room to gather one column into, kept for reorder()
+	std::vector<int32_t> reorderIds;
+	std::vector<uint8_t> reorderScratch;
+
+	void resetFreeIds();
+	void releaseId(int32_t id);
+
+	inline void wakeNeighbours(olc::vi2d pos) {
+		for (int y = std::max(pos.y - 1, 0); y <= std::min(pos.y + 1, PIX_Y - 1); y++) {
+			for (int x = std::max(pos.x - 1, 0); x <= std::min(pos.x + 1, PIX_X - 1); x++) {
+				int32_t id = this->grid[y][x];
+				if (id != NO_PARTICLE) {
+					this->blocked[id] = 0;
+					this->neighboursChanged[id] = true;
+				}
+			}
+		}
+	}
+};